@@ -7,6 +7,7 @@
 #include FT_FREETYPE_H
 #include <gtk/gtk.h>
 #include <librsvg/rsvg.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <sys/time.h>
@@ -39,6 +40,14 @@ void debug(format, ...) { if (debug_flag) fprintf(stdout, "%s:\033[31m%d\033[0m
 #define ICS_TEST_HANDLE1	13
 #define ICS_TEST_HANDLE2	14
 #define ICS_TEST_PLAYER1	15
+#define EXPORT_ARG		16
+#define EXPORT_SIZE_ARG		17
+#define EXPORT_DELAY_ARG	18
+#define THUMBNAILS_ARG		19
+#define THUMB_PLY_ARG		20
+#define THREADS_ARG		21
+#define ICS_RECORD_ARG		22
+#define ICS_REPLAY_ARG		23
 
 // base unicode char for chess fonts
 #define BASE_CHESS_UNICODE_CHAR 0x2654
@@ -47,6 +56,8 @@ void debug(format, ...) { if (debug_flag) fprintf(stdout, "%s:\033[31m%d\033[0m
 #define BLACK true
 
 #define SAN_MOVE_SIZE 16
+// A ply as shown in the moves list, with its move number and figurines
+#define MOVE_TEXT_SIZE 48
 #define MOVE_BUFF_SIZE 32
 
 typedef struct {
@@ -130,18 +141,44 @@ ply *ply_new(int oc, int or, int nc, int nr, chess_piece *taken, const char *san
  * */
 #define MOVES_LIST_ALLOC_PAGE_SIZE 256
 
+// Plys between two position snapshots, navigating replays at most this many
+#define SNAPSHOT_INTERVAL 16
+
+/* Compact copy of a position, to get back to it without replaying the
+ * game from the start */
+typedef struct {
+	unsigned char squares[32]; // col * 8 + row, white set then black set
+	unsigned char types[32]; // piece type, SNAPSHOT_DEAD when taken
+	unsigned char castle_state; // bit colour * 2 + side
+	unsigned char en_passant; // bit per column
+	unsigned char whose_turn;
+	unsigned short fifty_move_counter;
+	unsigned short current_move_number;
+	unsigned short ply_num;
+	int hash_history_index;
+	uint64_t current_hash;
+	uint64_t zobrist_hash_history[50]; // repetitions still count after navigating
+} position_snapshot;
+
+#define SNAPSHOT_DEAD 0x10
+
 /* NB: the list must be terminated by a NULL ply*/
 typedef struct {
     ply **plys;
     int plys_allocated;
     int last_ply;
     int viewed_ply;
+    // snapshots[k] is the position after k * SNAPSHOT_INTERVAL plys
+    position_snapshot *snapshots;
+    int snapshots_count;
+    int snapshots_allocated;
 } plys_list;
 
 plys_list *plys_list_new(void);
 void plys_list_free(plys_list *to_destroy);
 void plys_list_append_ply(plys_list *list, ply *to_append);
 void plys_list_print(plys_list *list);
+int show_ply(plys_list *list, int ply_num);
 
 enum {
 	KILLED_BY_NONE = 0,
@@ -152,9 +189,13 @@ enum {
 
 struct anim_data {
 	chess_piece *piece;
-	double **plots;
-	int n_plots;
-	int step_index;
+	double start[2];
+	double mid[2];
+	double end[2];
+	double prev[2];
+	gint64 start_time;
+	gint64 duration;
+	bool in_use;
 	int old_col;
 	int old_row;
 	int new_col;
@@ -253,12 +294,16 @@ extern long my_game;
 
 extern gboolean debug_flag;
 extern gboolean use_fig;
+extern gboolean image_layers_flag;
 extern gboolean ics_mode;
 extern bool guest_mode;
 extern bool load_file_specified;
 
 extern char ics_host[256];
 extern unsigned short ics_port;
+extern char ics_record_path[PATH_MAX];
+extern char ics_replay_path[PATH_MAX];
+extern gboolean replay_fast;
 extern char my_password[128];
 
 extern double svg_w, svg_h;
@@ -342,6 +387,7 @@ void flip_board(int wi, int hi);
 wint_t type_to_unicode_char(int type);
 bool can_i_move_piece(chess_piece* piece);
 void set_last_move(char *move);
+void set_last_move_squares(char *move, int squares[4], int promo_type);
 void start_game(char *w_name, char *b_name, int seconds, int increment, int relation, bool should_lock);
 void end_game(void);
 void update_eco_tag(bool should_lock_threads);
@@ -350,12 +396,19 @@ int resolve_move(chess_game *game, int t, char *move, int resolved_move[4]);
 void add_class(GtkWidget *, const char *);
 void insert_text_moves_list_view(const gchar *text, bool should_lock_threads);
 void refresh_moves_list_view(plys_list *list);
+int load_piecesSvg(void);
+void reset_position(chess_game *game);
+void reset_main_position(void);
+void reset_main_game(void);
+int parse_game_file(const char* file_path, int game_num);
+int open_file(const char *name);
 
 void show_login_dialog(bool lock_threads);
 void close_login_dialog(bool lock_threads);
 
 /********** FROM DRAWING BACKEND *************/
 extern RsvgHandle *piecesSvg[12];
+extern char theme_dir[];
 gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legality, int move_source, bool logical_only);
 
 /* Flex macros */
@@ -64,13 +64,11 @@ static double inactive_bg_g = INACTIVE_BG_G / 255.0;
 static double inactive_bg_b = INACTIVE_BG_B / 255.0;
 
 // Active clock font colour
-static char active_fg_hex[8];
 static double active_fg_r = ACTIVE_FG_R / 255.0;
 static double active_fg_g = ACTIVE_FG_G / 255.0;
 static double active_fg_b = ACTIVE_FG_B / 255.0;
 
 // Inactive clock font colour
-static char inactive_fg_hex[8];
 static double inactive_fg_r = INACTIVE_FG_R / 255.0;
 static double inactive_fg_g = INACTIVE_FG_G / 255.0;
 static double inactive_fg_b = INACTIVE_FG_B / 255.0;
@@ -81,42 +79,272 @@ static double warn_bg_g = WARN_BG_G / 255.0;
 static double warn_bg_b = WARN_BG_B / 255.0;
 
 // Active clock font colour for 7 segment ghost effect
-static char active_fg_ghost_hex[8];
 static double active_fg_ghost_r = ACTIVE_FG_GHOST_R / 255.0;
 static double active_fg_ghost_g = ACTIVE_FG_GHOST_G / 255.0;
 static double active_fg_ghost_b = ACTIVE_FG_GHOST_B / 255.0;
 
 // Inactive clock font colour for 7 segment ghost effect
-static char inactive_fg_ghost_hex[8];
 static double inactive_fg_ghost_r = INACTIVE_FG_GHOST_R / 255.0;
 static double inactive_fg_ghost_g = INACTIVE_FG_GHOST_G / 255.0;
 static double inactive_fg_ghost_b = INACTIVE_FG_GHOST_B / 255.0;
 
 // Low-on-time warning font colour for 7 segment ghost effect
-static char warn_fg_ghost_hex[8];
 static double warn_fg_ghost_r = WARN_FG_GHOST_R / 255.0;
 static double warn_fg_ghost_g = WARN_FG_GHOST_G / 255.0;
 static double warn_fg_ghost_b = WARN_FG_GHOST_B / 255.0;
 
-void rgb_to_css(char *hex, int r, int g, int b) {
-	sprintf(hex, "#%02X%02X%02X", r & 0xFF, g & 0xFF, b & 0xFF);
+enum {
+	STYLE_INACTIVE = 0,
+	STYLE_ACTIVE,
+	STYLE_WARN
+};
+
+// Colon colours
+enum {
+	COLON_INACTIVE_FG = 0,
+	COLON_ACTIVE_FG,
+	COLON_ACTIVE_GHOST,
+	COLON_WARN_GHOST
+};
+
+// Glyphs in the strip, in order
+static const char *GLYPH_CHARS = "0123456789:.-";
+
+// Glyph metrics are measured once at this size, they scale linearly
+#define REF_FONT_SIZE 100.0
+static double ref_glyph_width[CLOCK_GLYPHS];
+static double ref_glyph_height = 0;
+
+static int glyph_index(char c) {
+	const char *p = strchr(GLYPH_CHARS, c);
+	if (c == '\0' || p == NULL) {
+		return -1;
+	}
+	return (int) (p - GLYPH_CHARS);
 }
 
-void init_clock_colours(void) {
-	rgb_to_css(active_fg_hex, ACTIVE_FG_R, ACTIVE_FG_G, ACTIVE_FG_B);
-	rgb_to_css(inactive_fg_hex, INACTIVE_FG_R, INACTIVE_FG_G, INACTIVE_FG_B);
-	rgb_to_css(active_fg_ghost_hex, ACTIVE_FG_GHOST_R, ACTIVE_FG_GHOST_G, ACTIVE_FG_GHOST_B);
-	rgb_to_css(inactive_fg_ghost_hex, INACTIVE_FG_GHOST_R, INACTIVE_FG_GHOST_G, INACTIVE_FG_GHOST_B);
-	rgb_to_css(warn_fg_ghost_hex, WARN_FG_GHOST_R, WARN_FG_GHOST_G, WARN_FG_GHOST_B);
+static void measure_glyphs(ClockFace *cf, cairo_t *crt) {
+	int i, pix_width, pix_height;
+	char c[1];
+	PangoLayout *layout = pango_cairo_create_layout(crt);
+	pango_font_description_set_size(cf->font_desc, (gint) (REF_FONT_SIZE * PANGO_SCALE));
+	pango_layout_set_font_description(layout, cf->font_desc);
+	for (i = 0; i < CLOCK_GLYPHS; i++) {
+		c[0] = GLYPH_CHARS[i];
+		pango_layout_set_text(layout, c, 1);
+		pango_layout_get_pixel_size(layout, &pix_width, &pix_height);
+		ref_glyph_width[i] = pix_width;
+		if (pix_height > ref_glyph_height) {
+			ref_glyph_height = pix_height;
+		}
+	}
+	g_object_unref(layout);
 }
 
-gboolean draw_clock_face(GtkWidget *clock_face, cairo_t *crt) {
+static double ref_text_width(const char *text) {
+	double width = 0;
+	for (; *text; text++) {
+		int g = glyph_index(*text);
+		if (g >= 0) {
+			width += ref_glyph_width[g];
+		}
+	}
+	return width;
+}
+
+/* Largest font size (to .1pt) at which both clocks fit in their half */
+static float fit_font_size(const char *white, const char *black, int wi, int hi) {
+	int v_padding = 10;
+	int h_padding = 20;
+	double halfWidth = (double) wi / 2.0f;
+
+	float hi_font_size = (float) (hi / 1.5);
+	float wi_font_size = (float) (wi / 9.0);
+	double font_size = (hi_font_size < wi_font_size) ? hi_font_size : wi_font_size;
+
+	double ref_width = ref_text_width(white);
+	if (ref_text_width(black) > ref_width) {
+		ref_width = ref_text_width(black);
+	}
+	if (ref_width > 0 && font_size > (halfWidth - h_padding) * REF_FONT_SIZE / ref_width) {
+		font_size = (halfWidth - h_padding) * REF_FONT_SIZE / ref_width;
+	}
+	if (ref_glyph_height > 0 && font_size > (hi - v_padding) * REF_FONT_SIZE / ref_glyph_height) {
+		font_size = (hi - v_padding) * REF_FONT_SIZE / ref_glyph_height;
+	}
+	font_size = floor(font_size * 10) / 10;
+	return (float) (font_size < 1 ? 1 : font_size);
+}
+
+/* Rasterise all glyphs side by side into an alpha mask */
+static void build_glyph_strip(ClockFace *cf, cairo_t *crt) {
+	int i, pix_width, pix_height;
+	int strip_width = 0;
+	char c[1];
+
+	PangoLayout *layout = pango_cairo_create_layout(crt);
+	pango_font_description_set_size(cf->font_desc, (gint) (cf->font_size * PANGO_SCALE));
+	pango_layout_set_font_description(layout, cf->font_desc);
+
+	cf->glyph_height = 0;
+	for (i = 0; i < CLOCK_GLYPHS; i++) {
+		c[0] = GLYPH_CHARS[i];
+		pango_layout_set_text(layout, c, 1);
+		pango_layout_get_pixel_size(layout, &pix_width, &pix_height);
+		cf->glyph_x[i] = strip_width;
+		cf->glyph_width[i] = pix_width;
+		strip_width += pix_width;
+		if (pix_height > cf->glyph_height) {
+			cf->glyph_height = pix_height;
+		}
+	}
+
+	cairo_surface_destroy(cf->glyph_strip);
+	cf->glyph_strip = cairo_image_surface_create(CAIRO_FORMAT_A8, strip_width > 0 ? strip_width : 1,
+	                                             cf->glyph_height > 0 ? cf->glyph_height : 1);
+	cairo_t *strip_crt = cairo_create(cf->glyph_strip);
+	pango_cairo_update_layout(strip_crt, layout);
+	for (i = 0; i < CLOCK_GLYPHS; i++) {
+		c[0] = GLYPH_CHARS[i];
+		pango_layout_set_text(layout, c, 1);
+		cairo_move_to(strip_crt, cf->glyph_x[i], 0);
+		pango_cairo_show_layout(strip_crt, layout);
+	}
+	cairo_destroy(strip_crt);
+	g_object_unref(layout);
+}
+
+/* Blit glyph g of the strip at x, y in the current source colour */
+static void blit_glyph(ClockFace *cf, cairo_t *buff_crt, int g, double x, double y) {
+	if (g < 0) {
+		return;
+	}
+	cairo_save(buff_crt);
+	cairo_rectangle(buff_crt, x, y, cf->glyph_width[g], cf->glyph_height);
+	cairo_clip(buff_crt);
+	cairo_mask_surface(buff_crt, cf->glyph_strip, x - cf->glyph_x[g], y);
+	cairo_restore(buff_crt);
+}
+
+static void style_to_bg(int style, double rgb[3]) {
+	switch (style) {
+		case STYLE_WARN:
+			rgb[0] = warn_bg_r;
+			rgb[1] = warn_bg_g;
+			rgb[2] = warn_bg_b;
+			break;
+		case STYLE_ACTIVE:
+			rgb[0] = active_bg_r;
+			rgb[1] = active_bg_g;
+			rgb[2] = active_bg_b;
+			break;
+		default:
+			rgb[0] = inactive_bg_r;
+			rgb[1] = inactive_bg_g;
+			rgb[2] = inactive_bg_b;
+			break;
+	}
+}
+
+static void set_colon_colour(cairo_t *buff_crt, int colon_colour) {
+	switch (colon_colour) {
+		case COLON_ACTIVE_FG:
+			cairo_set_source_rgb(buff_crt, active_fg_r, active_fg_g, active_fg_b);
+			break;
+		case COLON_ACTIVE_GHOST:
+			cairo_set_source_rgb(buff_crt, active_fg_ghost_r, active_fg_ghost_g, active_fg_ghost_b);
+			break;
+		case COLON_WARN_GHOST:
+			cairo_set_source_rgb(buff_crt, warn_fg_ghost_r, warn_fg_ghost_g, warn_fg_ghost_b);
+			break;
+		default:
+			cairo_set_source_rgb(buff_crt, inactive_fg_r, inactive_fg_g, inactive_fg_b);
+			break;
+	}
+}
 
-	static int last_wi = -1;
-	static int last_hi = -1;
-	static size_t last_white_len = 0;
-	static size_t last_black_len = 0;
-	static float font_size = -1;
+/* Compose one half of the clock in the back buffer from the glyph strip.
+ * Only the characters that differ from what the buffer already shows are
+ * repainted, unless the style changed */
+static void paint_clock_half(ClockFace *cf, cairo_t *buff_crt, int black, const char *text, const char *ghost,
+                             int style, int colon_colour, double halfWidth, int hi) {
+	size_t i;
+	size_t len = strlen(text);
+	double x0 = black ? halfWidth : 0;
+
+	// Glyph positions
+	int text_width = 0;
+	int cell_x[32];
+	for (i = 0; i < len && i < 32; i++) {
+		int g = glyph_index(text[i]);
+		cell_x[i] = text_width;
+		text_width += g < 0 ? 0 : cf->glyph_width[g];
+	}
+	len = i;
+	// only the minutes:seconds colon blinks, not the one after the hours
+	const char *last_colon = strrchr(text, ':');
+	size_t colon = last_colon != NULL ? (size_t) (last_colon - text) : len;
+	double tx = floor(x0 + .5 * (halfWidth - text_width));
+	double ty = floor(.5 * (hi - cf->glyph_height));
+
+	bool full = style != cf->shown_style[black] || len != strlen(cf->shown[black]);
+	if (full) {
+		// background
+		double bg[3];
+		style_to_bg(style, bg);
+		cairo_save(buff_crt);
+		cairo_rectangle(buff_crt, x0, 0, halfWidth, hi);
+		cairo_clip(buff_crt);
+		cairo_set_source_rgb(buff_crt, bg[0], bg[1], bg[2]);
+		cairo_paint(buff_crt);
+		cairo_restore(buff_crt);
+	}
+
+	double bg[3];
+	style_to_bg(style, bg);
+	for (i = 0; i < len; i++) {
+		int g = glyph_index(text[i]);
+		if (g < 0) {
+			continue;
+		}
+		if (!full && text[i] == cf->shown[black][i] && (i != colon || colon_colour == cf->shown_colon[black])) {
+			continue;
+		}
+		double x = tx + cell_x[i];
+
+		if (!full) {
+			cairo_set_source_rgb(buff_crt, bg[0], bg[1], bg[2]);
+			cairo_rectangle(buff_crt, x, ty, cf->glyph_width[g], cf->glyph_height);
+			cairo_fill(buff_crt);
+		}
+
+		// 7 segment ghost
+		if (style == STYLE_WARN) {
+			cairo_set_source_rgb(buff_crt, warn_fg_ghost_r, warn_fg_ghost_g, warn_fg_ghost_b);
+		} else if (style == STYLE_ACTIVE) {
+			cairo_set_source_rgb(buff_crt, active_fg_ghost_r, active_fg_ghost_g, active_fg_ghost_b);
+		} else {
+			cairo_set_source_rgb(buff_crt, inactive_fg_ghost_r, inactive_fg_ghost_g, inactive_fg_ghost_b);
+		}
+		blit_glyph(cf, buff_crt, glyph_index(ghost[i]), x, ty);
+
+		// digit, with the colon in its own colour
+		if (i == colon) {
+			set_colon_colour(buff_crt, colon_colour);
+		} else if (style != STYLE_INACTIVE) {
+			cairo_set_source_rgb(buff_crt, active_fg_r, active_fg_g, active_fg_b);
+		} else {
+			cairo_set_source_rgb(buff_crt, inactive_fg_r, inactive_fg_g, inactive_fg_b);
+		}
+		blit_glyph(cf, buff_crt, g, x, ty);
+	}
+
+	snprintf(cf->shown[black], sizeof(cf->shown[black]), "%s", text);
+	cf->shown_style[black] = style;
+	cf->shown_colon[black] = colon_colour;
+}
+
+gboolean draw_clock_face(GtkWidget *clock_face, cairo_t *crt) {
 
 	ClockFace *cf = CLOCK_FACE(clock_face);
 
@@ -127,12 +355,26 @@ gboolean draw_clock_face(GtkWidget *clock_face, cairo_t *crt) {
 
 	pthread_mutex_lock(&mutex_drawing);
 
-	cairo_surface_t *buffer_surf = cairo_image_surface_create(
-			CAIRO_FORMAT_ARGB32, 
-			gtk_widget_get_allocated_width(clock_face),
-			gtk_widget_get_allocated_height(clock_face));
+	int wi = gtk_widget_get_allocated_width(clock_face);
+	int hi = gtk_widget_get_allocated_height(clock_face);
+
+	// Back buffer only follows allocation changes
+	bool new_buffer = false;
+	if (cf->buffer == NULL || cf->last_wi != wi || cf->last_hi != hi) {
+		cairo_surface_destroy(cf->buffer);
+		cf->buffer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, wi, hi);
+		cf->shown_style[0] = cf->shown_style[1] = -1;
+		new_buffer = true;
+	}
 
-	cairo_t *buff_crt = cairo_create(buffer_surf);
+	cairo_t *buff_crt = cairo_create(cf->buffer);
+
+	if (cf->font_desc == NULL) {
+		cf->font_desc = pango_font_description_from_string(FONT_FACE);
+	}
+	if (ref_glyph_height <= 0) {
+		measure_glyphs(cf, buff_crt);
+	}
 
 	char white[32];
 	char white_ghost[32];
@@ -142,97 +384,33 @@ gboolean draw_clock_face(GtkWidget *clock_face, cairo_t *crt) {
 	clock_to_string(cf->clock, 0, white, white_ghost);
 	clock_to_string(cf->clock, 1, black, black_ghost);
 
-	PangoFontDescription *desc;
-	PangoLayout *layout;
-
-	layout = pango_cairo_create_layout(buff_crt);
-
-	char font_str[32];
-
-	float hi_font_size;
-	float wi_font_size;
-
-	int wi = gtk_widget_get_allocated_width(clock_face);
-	int hi = gtk_widget_get_allocated_height(clock_face);
-
 	size_t white_len = strlen(white);
 	size_t black_len = strlen(black);
 
-	// Create and Set font description
-
 	/* *
 	 * Find Optimal Font Size in points
-	 * the initial guessed size is an average from experiments 
+	 * the initial guessed size is an average from experiments
 	 * but is adjusted for the current display if too big
 	 * */
-	double halfWidth = (double) wi / 2.0f;
-	int w_pix_width, w_pix_height, b_pix_width, b_pix_height;
-
-	if (last_wi == wi && last_hi == hi && last_white_len == white_len && last_black_len == black_len) {
-		// Reuse font size as previously calculated
-		sprintf(font_str, "%s %.1f", FONT_FACE, font_size);
-		desc = pango_font_description_from_string(font_str);
-		pango_layout_set_font_description(layout, desc);
-		pango_font_description_free(desc);
-
-		pango_layout_set_text(layout, black, -1);
-		pango_layout_get_pixel_size(layout, &b_pix_width, &b_pix_height);
-
-		pango_layout_set_text(layout, white, -1);
-		pango_layout_get_pixel_size(layout, &w_pix_width, &w_pix_height);
-	} else {
-		// Calculating new font size since things have changed
-		float last_font_size = font_size;
-
-		int v_padding = 10;
-		int h_padding = 20;
-
-		hi_font_size = (float) (hi / 1.5);
-		wi_font_size = (float) (wi / 9.0);
-		font_size = (hi_font_size < wi_font_size) ? hi_font_size : wi_font_size;
-
-		sprintf(font_str, "%s %.1f", FONT_FACE, font_size);
-		desc = pango_font_description_from_string(font_str);
-		pango_layout_set_font_description(layout, desc);
-		pango_font_description_free(desc);
-
-		// Ensure both clocks fit
-		pango_layout_set_text(layout, black, -1);
-		pango_layout_get_pixel_size(layout, &b_pix_width, &b_pix_height);
-		while ((b_pix_height > hi - v_padding || b_pix_width > halfWidth - h_padding) && font_size > 1) {
-			font_size -= .1;
-			sprintf(font_str, "%s %.2f", FONT_FACE, font_size);
-			desc = pango_font_description_from_string(font_str);
-			pango_layout_set_font_description(layout, desc);
-			pango_font_description_free(desc);
-			pango_layout_get_pixel_size(layout, &b_pix_width, &b_pix_height);
-		}
-		pango_layout_set_text(layout, white, -1);
-		pango_layout_get_pixel_size(layout, &w_pix_width, &w_pix_height);
-		while ((w_pix_height > hi - v_padding || w_pix_width > halfWidth - h_padding) && font_size > 1) {
-			font_size -= .1;
-			sprintf(font_str, "%s %.2f", FONT_FACE, font_size);
-			desc = pango_font_description_from_string(font_str);
-			pango_layout_set_font_description(layout, desc);
-			pango_font_description_free(desc);
-			pango_layout_get_pixel_size(layout, &w_pix_width, &w_pix_height);
-		}
-
-		if (last_font_size > -1 && font_size != last_font_size) {
-			// Redraw whole clock as font size of both should change
-			gtk_widget_queue_draw(clock_face);
+	if (new_buffer || cf->last_len[0] != white_len || cf->last_len[1] != black_len) {
+		float last_font_size = cf->font_size;
+		cf->font_size = fit_font_size(white, black, wi, hi);
+
+		// The strip is only rasterised again when the size actually changes
+		if (cf->font_size != last_font_size || cf->glyph_strip == NULL) {
+			build_glyph_strip(cf, buff_crt);
+			cf->shown_style[0] = cf->shown_style[1] = -1;
+			if (last_font_size > 0) {
+				// Redraw whole clock as font size of both should change
+				gtk_widget_queue_draw(clock_face);
+			}
 		}
 	}
 
-	last_wi = wi;
-	last_hi = hi;
-	last_white_len = white_len;
-	last_black_len = black_len;
-
-//	printf("Allocated height == %dpx\n", hi);
-//	printf("Final font size %f\n", font_size);
-//	printf("Final H ratio %f\n", hi / font_size);
-//	printf("Final W ratio %f\n", wi / font_size);
+	cf->last_wi = wi;
+	cf->last_hi = hi;
+	cf->last_len[0] = white_len;
+	cf->last_len[1] = black_len;
 
 	int wa = is_active(cf->clock, 0);
 	int ba = is_active(cf->clock, 1);
@@ -252,8 +430,6 @@ gboolean draw_clock_face(GtkWidget *clock_face, cairo_t *crt) {
 		}
 	}
 
-	cairo_save(buff_crt);
-
 	struct timeval my_time = cf->clock->remaining_time[cf->clock->relation > 0 ? 0 : 1];
 	struct timeval active_time = cf->clock->remaining_time[wa ? 0 : 1];
 	bool warn_toggle;
@@ -266,181 +442,73 @@ gboolean draw_clock_face(GtkWidget *clock_face, cairo_t *crt) {
 		colon_toggle = active_time.tv_usec > 500000;
 	}
 
-	// paint white's clock background
-	double w_bg_r, w_bg_g, w_bg_b;
-	if (wa) {
-		if (warn_me && warn_toggle) {
-			w_bg_r = warn_bg_r;
-			w_bg_g = warn_bg_g;
-			w_bg_b = warn_bg_b;
+	int styles[2];
+	int colon_colours[2];
+	int actives[2] = { wa, ba };
+	int i;
+	for (i = 0; i < 2; i++) {
+		if (actives[i]) {
+			styles[i] = (warn_me && warn_toggle) ? STYLE_WARN : STYLE_ACTIVE;
+			colon_colours[i] = colon_toggle ? COLON_ACTIVE_FG
+			                                : (styles[i] == STYLE_WARN ? COLON_WARN_GHOST : COLON_ACTIVE_GHOST);
 		} else {
-			w_bg_r = active_bg_r;
-			w_bg_g = active_bg_g;
-			w_bg_b = active_bg_b;
+			styles[i] = STYLE_INACTIVE;
+			colon_colours[i] = COLON_INACTIVE_FG;
 		}
-	} else {
-		w_bg_r = inactive_bg_r;
-		w_bg_g = inactive_bg_g;
-		w_bg_b = inactive_bg_b;
 	}
-	cairo_set_source_rgb(buff_crt, w_bg_r, w_bg_g, w_bg_b);
-	cairo_rectangle(buff_crt, 0, 0, halfWidth, hi);
-	cairo_fill(buff_crt);
-
-	// paint white's clock text
-	double tx = .5 * (wi / 2.0f - w_pix_width);
-	double ty = .5 * (hi - w_pix_height);
-	cairo_translate(buff_crt, tx, ty);
-
-	pango_layout_set_text(layout, white_ghost, -1);
-	char *colon_colour;
-	if (wa) {
-		colon_colour = colon_toggle ? active_fg_hex : active_fg_ghost_hex;
-		if (warn_me && warn_toggle) {
-			cairo_set_source_rgb(buff_crt, warn_fg_ghost_r, warn_fg_ghost_g, warn_fg_ghost_b);
-			colon_colour = colon_toggle ? active_fg_hex : warn_fg_ghost_hex;
-		} else {
-			cairo_set_source_rgb(buff_crt, active_fg_ghost_r, active_fg_ghost_g, active_fg_ghost_b);
-		}
-	} else {
-		colon_colour = inactive_fg_hex;
-		cairo_set_source_rgb(buff_crt, inactive_fg_ghost_r, inactive_fg_ghost_g, inactive_fg_ghost_b);
-	}
-	pango_cairo_show_layout(buff_crt, layout);
-
-	char markup[256];
-	char *colon = strrchr(white, ':');
-	char before_colon[16];
-	char after_colon[16];
-	memset(before_colon, 0, 16);
-	memset(after_colon, 0, 16);
-	memcpy(before_colon, white, colon - white);
-	size_t prefixLen = strlen(before_colon);
-	memcpy(after_colon, colon + 1, white_len - prefixLen - 1);
-
-	sprintf(markup, "%s<span foreground=\"%s\">:</span>%s", before_colon, colon_colour, after_colon);
-	pango_layout_set_markup(layout, markup, -1);
-	if (wa) {
-		cairo_set_source_rgb(buff_crt, active_fg_r, active_fg_g, active_fg_b);
-	} else {
-		cairo_set_source_rgb(buff_crt, inactive_fg_r, inactive_fg_g, inactive_fg_b);
-	}
-	pango_cairo_show_layout(buff_crt, layout);
-
-
-	cairo_restore(buff_crt);
-	cairo_save(buff_crt);
-
-	// paint black's clock background
-	cairo_translate(buff_crt, halfWidth, 0);
 
-	double b_bg_r, b_bg_g, b_bg_b;
-	if (ba) {
-		if (warn_me && warn_toggle) {
-			b_bg_r = warn_bg_r;
-			b_bg_g = warn_bg_g;
-			b_bg_b = warn_bg_b;
-		} else {
-			b_bg_r = active_bg_r;
-			b_bg_g = active_bg_g;
-			b_bg_b = active_bg_b;
-		}
-	} else {
-		b_bg_r = inactive_bg_r;
-		b_bg_g = inactive_bg_g;
-		b_bg_b = inactive_bg_b;
-	}
-	cairo_set_source_rgb(buff_crt, b_bg_r, b_bg_g, b_bg_b);
-	cairo_rectangle(buff_crt, 0, 0, halfWidth, hi);
-	cairo_fill(buff_crt);
-
-	// paint black's clock text
-	tx = .5 * (wi / 2.0f - b_pix_width);
-	cairo_translate(buff_crt, tx, ty);
-	pango_layout_set_text(layout, black_ghost, -1);
-	if (ba) {
-		colon_colour = colon_toggle ? active_fg_hex : active_fg_ghost_hex;
-		if (warn_me && warn_toggle) {
-			cairo_set_source_rgb(buff_crt, warn_fg_ghost_r, warn_fg_ghost_g, warn_fg_ghost_b);
-			colon_colour = colon_toggle ? active_fg_hex : warn_fg_ghost_hex;
-		} else {
-			cairo_set_source_rgb(buff_crt, active_fg_ghost_r, active_fg_ghost_g, active_fg_ghost_b);
-		}
-	} else {
-		colon_colour = inactive_fg_hex;
-		cairo_set_source_rgb(buff_crt, inactive_fg_ghost_r, inactive_fg_ghost_g, inactive_fg_ghost_b);
-	}
-	pango_cairo_show_layout(buff_crt, layout);
-
-	colon = strrchr(black, ':');
-	memset(before_colon, 0, 16);
-	memset(after_colon, 0, 16);
-	memcpy(before_colon, black, colon - black);
-	prefixLen = strlen(before_colon);
-	memcpy(after_colon, colon + 1, black_len - prefixLen - 1);
-
-	sprintf(markup, "%s<span foreground=\"%s\">:</span>%s", before_colon, colon_colour, after_colon);
-	pango_layout_set_markup(layout, markup, -1);
-	pango_layout_get_pixel_size(layout, &b_pix_width, &b_pix_height);
-
-	if (ba) {
-		if (warn_me && warn_toggle) {
-			cairo_set_source_rgb(buff_crt, warn_fg_ghost_r, warn_fg_ghost_g, warn_fg_ghost_b);
-		} else {
-			cairo_set_source_rgb(buff_crt, active_fg_ghost_r, active_fg_ghost_g, active_fg_ghost_b);
-		}
-	} else {
-		cairo_set_source_rgb(buff_crt, inactive_fg_ghost_r, inactive_fg_ghost_g, inactive_fg_ghost_b);
-	}
-	pango_cairo_show_layout(buff_crt, layout);
-
-	if (ba) {
-		cairo_set_source_rgb(buff_crt, active_fg_r, active_fg_g, active_fg_b);
-	}
-	else {
-		cairo_set_source_rgb(buff_crt, inactive_fg_r, inactive_fg_g, inactive_fg_b);
-	}
-	pango_layout_set_text(layout, black, -1);
-	pango_cairo_show_layout(buff_crt, layout);
-
-	cairo_restore(buff_crt);
-
-	// debug clock text bounds
-//	pango_layout_set_text(layout, white, -1);
-//	pango_layout_get_pixel_size(layout, &pix_width, &pix_height);
-//	double rx = .5 * (wi / 2.0f - pix_width);
-//	double ry = .5 * (hi - pix_height);
-//	cairo_set_source_rgb(buff_crt, 1, 1, 1);
-//	cairo_rectangle(buff_crt, rx, ry, pix_width, pix_height);
-//	cairo_set_line_width(buff_crt, 1);
-//	cairo_stroke(buff_crt);
+	double halfWidth = (double) wi / 2.0f;
+	paint_clock_half(cf, buff_crt, 0, white, white_ghost, styles[0], colon_colours[0], halfWidth, hi);
+	paint_clock_half(cf, buff_crt, 1, black, black_ghost, styles[1], colon_colours[1], halfWidth, hi);
 
 	// paint separator on boundary to avoid aliasing
-	cairo_set_source_rgb(buff_crt, (w_bg_r + b_bg_r) / 2.0, (w_bg_g + b_bg_g) / 2.0, (w_bg_b + b_bg_b) / 2.0);
+	double w_bg[3], b_bg[3];
+	style_to_bg(styles[0], w_bg);
+	style_to_bg(styles[1], b_bg);
+	cairo_set_source_rgb(buff_crt, (w_bg[0] + b_bg[0]) / 2.0, (w_bg[1] + b_bg[1]) / 2.0, (w_bg[2] + b_bg[2]) / 2.0);
 
 	cairo_move_to (buff_crt, halfWidth, 0);
 	cairo_line_to(buff_crt, halfWidth, hi);
 	cairo_set_line_width(buff_crt, 1.0f);
 	cairo_stroke(buff_crt);
 
+	cairo_destroy(buff_crt);
+
 	// Apply cache surface to crt
-	cairo_set_source_surface(crt, buffer_surf, 0.0f, 0.0f);
+	cairo_set_source_surface(crt, cf->buffer, 0.0f, 0.0f);
 	cairo_paint(crt);
 
-	// Cleanup
-	g_object_unref(layout);
-	cairo_destroy(buff_crt);
-	cairo_surface_destroy(buffer_surf);
 	pthread_mutex_unlock(&mutex_drawing);
+	return FALSE;
+}
+
+static void clock_face_finalize(GObject *object) {
+	ClockFace *cf = CLOCK_FACE(object);
+	cairo_surface_destroy(cf->buffer);
+	cairo_surface_destroy(cf->glyph_strip);
+	if (cf->font_desc) {
+		pango_font_description_free(cf->font_desc);
+	}
+	G_OBJECT_CLASS(clock_face_parent_class)->finalize(object);
 }
 
 static void clock_face_class_init(ClockFaceClass *class) {
 	GtkWidgetClass *widget_class;
 	widget_class = GTK_WIDGET_CLASS (class);
 	widget_class->draw = draw_clock_face;
+	G_OBJECT_CLASS(class)->finalize = clock_face_finalize;
 }
 
-static void clock_face_init(ClockFace *clock_face) {}
+static void clock_face_init(ClockFace *clock_face) {
+	clock_face->buffer = NULL;
+	clock_face->glyph_strip = NULL;
+	clock_face->font_desc = NULL;
+	clock_face->font_size = -1;
+	clock_face->last_wi = -1;
+	clock_face->last_hi = -1;
+	clock_face->shown_style[0] = clock_face->shown_style[1] = -1;
+	clock_face->shown[0][0] = clock_face->shown[1][0] = '\0';
+}
 
 void clock_face_set_clock(ClockFace *clock_face, chess_clock *clock) {
 	clock_face->clock = clock;
@@ -14,6 +14,8 @@ G_BEGIN_DECLS
 #define CLOCK_FACE_GET_CLASS	 (G_TYPE_INSTANCE_GET_CLASS ((obj), TYPE_CLOCK_FACE, ClockFaceClass))
 
 
+#define CLOCK_GLYPHS 13
+
 typedef struct _ClockFace	ClockFace;
 typedef struct _ClockFaceClass	ClockFaceClass;
 
@@ -21,6 +23,25 @@ struct _ClockFace {
 	GtkDrawingArea parent;
 	/* the chess_clock displayed by this widget */
 	chess_clock *clock; 
+
+	/* back buffer, only reallocated when the allocation changes */
+	cairo_surface_t *buffer;
+	PangoFontDescription *font_desc;
+	float font_size;
+	int last_wi;
+	int last_hi;
+	size_t last_len[2];
+
+	/* 0-9, ':', '.' and '-' rasterised at font_size, side by side */
+	cairo_surface_t *glyph_strip;
+	int glyph_x[CLOCK_GLYPHS];
+	int glyph_width[CLOCK_GLYPHS];
+	int glyph_height;
+
+	/* what each half of the back buffer currently shows */
+	char shown[2][32];
+	int shown_style[2];
+	int shown_colon[2];
 };
 
 struct _ClockFaceClass {
@@ -29,8 +50,6 @@ struct _ClockFaceClass {
 
 G_END_DECLS
 
-void init_clock_colours(void);
-
 GtkWidget *clock_face_new(void);
 
 void clock_face_set_clock(ClockFace *clock_face, chess_clock *clock);
@@ -18,21 +18,24 @@
 #include "cairo-board.h"
 #include "chess-backend.h"
 #include "crafty-adapter.h"
+#include "sprite-cache.h"
 
 chess_game *main_game;
 
 /* Prototypes */
 static void clean_last_drag_step(cairo_t *cdc, double wi, double hi);
-static void plot_coords(double start[2], double mid[2], double end[2], int points_to_plot, double **plots, int *nPlots);
-static void free_anim_data(struct anim_data *anim);
+static void release_anim_data(gpointer data);
 static void square_to_rectangle(cairo_t *dc, int col, int row, int wi, int hi);
-static void squares_for_move(cairo_t *dc, int move[4], int wi, int hi);
-static void clip_to_square(cairo_t *dc, int col, int row, int wi, int hi);
 static void highlight_square(cairo_t *dc, int col, int row, double r, double g, double b, double a, int wi, int hi);
 static void highlight_check_square(cairo_t *dc, int col, int row, double r, double g, double b, double a, int wi, int hi);
 static void update_dragging_background(chess_piece *piece, int wi, int hi);
 static void restore_dragging_background(chess_piece *piece, int move_result, int wi, int hi);
 static void logical_promote(int last_promote);
+static void invalidate_rectangle(double x, double y, double w, double h);
+static void reset_layer(cairo_surface_t **layer, int wi, int hi);
+static cairo_surface_t *create_layer(int wi, int hi);
+static bool layer_has_size(cairo_surface_t *layer, int wi, int hi);
+static gboolean drag_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer data);
 
 static const char *FONT_FACE = "Sans";
 
@@ -56,12 +59,34 @@ cairo_surface_t *highlight_over_layer = NULL;
 cairo_surface_t *cache_layer = NULL;
 cairo_surface_t *dragging_background = NULL;
 
+// Native layers can't be queried for their size, so it is attached to them
+static const cairo_user_data_key_t layer_size_key;
+
+// Checker period the board layer is tiled from, and coordinate label masks
+static cairo_surface_t *square_tiles = NULL;
+static cairo_surface_t *coordinate_glyphs[16];
+static int tiles_wi = 0;
+static int tiles_hi = 0;
+
 RsvgHandle *piecesSvg[12];
 cairo_surface_t *piece_surfaces[12];
 
 GHashTable *anims_map;
 
+// Easing curve shared by all animations, sampled over [0, 1]
+#define EASE_TABLE_SIZE 256
+static double ease_table[EASE_TABLE_SIZE + 1];
+
+// Animations are taken from here rather than malloc'd
+#define ANIM_POOL_SIZE 64
+static struct anim_data anim_pool[ANIM_POOL_SIZE];
+static pthread_mutex_t anim_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Animation length per point of the old plot count (it used an 8ms timer)
+#define ANIM_STEP_USEC 8000
+
 static gboolean is_scaled = false;
+static guint drag_tick_id = 0;
 static bool just_made_premove = false;
 
 static chess_piece *mouse_clicked_piece = NULL;
@@ -72,8 +97,65 @@ static chess_piece *king_in_check_piece = NULL;
 int prev_highlighted_move[4] = {-1};
 int prev_highlighted_pre_move[4] = {-1};
 
+// Damage tracking: one bit per square, indexed by col * 8 + row
+#define SQUARE_BIT(col, row) (((uint64_t) 1) << ((col) * 8 + (row)))
+#define ALL_SQUARES (~((uint64_t) 0))
+
+// Squares whose layers changed since the last flush
+static uint64_t dirty_squares = 0;
+// Squares currently painted on highlight_under_layer
+static uint64_t highlighted_squares = 0;
+
 void init_anims_map(void) {
 	anims_map = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	// Exponential ease-in, normalised so that it goes from 0 to 1
+	int i;
+	for (i = 0; i <= EASE_TABLE_SIZE; i++) {
+		ease_table[i] = (pow(50, (double) i / EASE_TABLE_SIZE) - 1.0f) / 49.0f;
+	}
+}
+
+static double ease_lookup(double x) {
+	double pos = x * EASE_TABLE_SIZE;
+	if (pos <= 0) {
+		return ease_table[0];
+	}
+	int i = (int) pos;
+	if (i >= EASE_TABLE_SIZE) {
+		return ease_table[EASE_TABLE_SIZE];
+	}
+	return ease_table[i] + (ease_table[i + 1] - ease_table[i]) * (pos - i);
+}
+
+static struct anim_data *acquire_anim_data(void) {
+	int i;
+	pthread_mutex_lock(&anim_pool_lock);
+	for (i = 0; i < ANIM_POOL_SIZE; i++) {
+		if (!anim_pool[i].in_use) {
+			memset(&anim_pool[i], 0, sizeof(struct anim_data));
+			anim_pool[i].in_use = true;
+			pthread_mutex_unlock(&anim_pool_lock);
+			return &anim_pool[i];
+		}
+	}
+	pthread_mutex_unlock(&anim_pool_lock);
+
+	// Can only happen with a flood of moves, don't drop the animation
+	debug("Animation pool exhausted\n");
+	return calloc(1, sizeof(struct anim_data));
+}
+
+/* Destroy notify of the animation tick callback */
+static void release_anim_data(gpointer data) {
+	struct anim_data *anim = (struct anim_data *)data;
+	if (anim < anim_pool || anim >= anim_pool + ANIM_POOL_SIZE) {
+		free(anim);
+		return;
+	}
+	pthread_mutex_lock(&anim_pool_lock);
+	anim->in_use = false;
+	pthread_mutex_unlock(&anim_pool_lock);
 }
 
 struct anim_data *get_anim_for_piece(chess_piece *piece) {
@@ -81,16 +163,14 @@ struct anim_data *get_anim_for_piece(chess_piece *piece) {
 }
 
 void update_pieces_surfaces(int wi, int hi) {
-	cairo_t *dc;
 	int i;
+	cairo_surface_t *sprites[12];
+
+	// rendered in parallel, then published all at once
+	sprite_cache_get_set(theme_dir, (int) (((double) wi) / 8.0f), (int) (((double) hi) / 8.0f), sprites);
 	for (i = 0; i < 12; i++) {
 		cairo_surface_destroy(piece_surfaces[i]);
-		piece_surfaces[i] = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, (int) (((double) wi) / 8.0f),
-		                                               (int) (((double) hi) / 8.0f));
-		dc = cairo_create(piece_surfaces[i]);
-		cairo_scale(dc, wi * svg_w, hi * svg_h);
-		rsvg_handle_render_cairo(piecesSvg[i], dc);
-		cairo_destroy(dc);
+		piece_surfaces[i] = sprites[i];
 	}
 	assign_surfaces();
 }
@@ -102,22 +182,19 @@ void apply_surface_at(cairo_t *cdc, cairo_surface_t *surf, double x, double y, d
 	cairo_fill(cdc);
 }
 
-void draw_board_surface(int width, int height) {
-
-	int j,k;
-	double tx = width / 8.0;
-	double ty = height / 8.0;
-
-	bool flipped = is_board_flipped();
+/* Render one checker period (2x2 squares) with the shading and smoothing
+ * lines baked in. The board layer is then filled with it in a single paint */
+static void draw_square_tiles(double tx, double ty) {
+	int j, k;
+	int atlas_wi = (int) ceil(2.0f * tx);
+	int atlas_hi = (int) ceil(2.0f * ty);
 
-	// Create a "memory-buffer" surface to draw on
-	cairo_surface_destroy(board_layer);
-	board_layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
-	cairo_t *cr = cairo_create(board_layer);
+	cairo_surface_destroy(square_tiles);
+	square_tiles = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, atlas_wi, atlas_hi);
+	cairo_t *cr = cairo_create(square_tiles);
 
-	cairo_surface_destroy(coordinates_layer);
-	coordinates_layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
-	cairo_t *coordinates_cr = cairo_create(coordinates_layer);
+	// Stretch so that the period fills the atlas exactly
+	cairo_scale(cr, atlas_wi / (2.0f * tx), atlas_hi / (2.0f * ty));
 
 	cairo_pattern_t *dark_square_pattern = cairo_pattern_create_rgb(dr, dg, db);
 	cairo_pattern_t *light_square_pattern = cairo_pattern_create_rgb(lr, lg, lb);
@@ -132,65 +209,51 @@ void draw_board_surface(int width, int height) {
 	cairo_pattern_add_color_stop_rgba(dark_gradient_pattern, 0.0f, lr, lg, lb, 0.25f);
 	cairo_pattern_add_color_stop_rgba(dark_gradient_pattern, 1.0f, 1, 1, 1, 0.0f);
 
-	// Draw Dark Squares
-	cairo_set_source(cr, dark_square_pattern);
-	for (j = 0; j < 8; j++) {
-		for (k = 0; k < 8; k++) {
-			if (get_square_colour(j, k)) {
-				cairo_rectangle(cr, j*tx, k*ty, tx, ty);
-				cairo_fill(cr);
-
-				// Inner shadow effect
-				cairo_save(cr);
-				cairo_translate(cr, j*tx, k*ty);
-				cairo_set_source (cr, dark_gradient_pattern);
-				cairo_rectangle(cr, 0, 0, tx, ty);
-				cairo_fill(cr);
-				cairo_restore(cr);
-
-			}
+	for (j = 0; j < 2; j++) {
+		for (k = 0; k < 2; k++) {
+			bool dark = get_square_colour(j, k);
+			cairo_save(cr);
+			cairo_translate(cr, j*tx, k*ty);
+			cairo_rectangle(cr, 0, 0, tx, ty);
+			cairo_set_source(cr, dark ? dark_square_pattern : light_square_pattern);
+			cairo_fill_preserve(cr);
+
+			// Inner shadow effect
+			cairo_set_source(cr, dark ? dark_gradient_pattern : light_gradient_pattern);
+			cairo_fill(cr);
+			cairo_restore(cr);
 		}
 	}
 
-	// Draw Light Squares
-	cairo_set_source(cr, light_square_pattern);
-	for (j = 0; j < 8; j++) {
-		for (k = 0; k < 8; k++) {
-			if (!get_square_colour(j, k)) {
-				cairo_rectangle(cr, j*tx, k*ty, tx, ty);
-				cairo_fill(cr);
-
-				cairo_save(cr);
-				cairo_translate(cr, j*tx, k*ty);
-				cairo_set_source (cr, light_gradient_pattern);
-				cairo_rectangle(cr, 0, 0, tx, ty);
-				cairo_fill(cr);
-				cairo_restore(cr);
-			}
-		}
-	}
-
-	// Draw smoothing lines between squares
-	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	// Draw smoothing lines between squares, halves at the edges meet when tiled
 	cairo_set_source_rgb(cr, (dr + lr) / 2.0f, (dg + lg) / 2.0f, (db + lb) / 2.0f);
 	cairo_set_line_width(cr, 1.0f);
-
-	// Vertical lines
-	for (j = 0; j <= 8; j++) {
-		cairo_move_to (cr, j * tx, 0);
-		cairo_line_to(cr, j * tx, height);
+	for (j = 0; j <= 2; j++) {
+		cairo_move_to(cr, j * tx, 0);
+		cairo_line_to(cr, j * tx, 2.0f * ty);
+		cairo_move_to(cr, 0, j * ty);
+		cairo_line_to(cr, 2.0f * tx, j * ty);
 	}
-	// Horizontal lines
-	for (j = 0; j <= 8; j++) {
-		cairo_move_to (cr, 0, j * ty);
-		cairo_line_to(cr, width, j * ty);
-	}
-	cairo_stroke (cr);
+	cairo_stroke(cr);
+
+	cairo_destroy(cr);
+	cairo_pattern_destroy(dark_square_pattern);
+	cairo_pattern_destroy(light_square_pattern);
+	cairo_pattern_destroy(dark_gradient_pattern);
+	cairo_pattern_destroy(light_gradient_pattern);
+}
+
+/* Rasterise the coordinate labels as alpha masks, so that they can be
+ * painted in either square colour */
+static void draw_coordinate_glyphs(double tx) {
+	int j;
+	char coord[1];
+	cairo_surface_t *scratch = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+	cairo_t *scratch_cr = cairo_create(scratch);
 
-	// Draw coordinates
 	PangoFontDescription *desc;
 	PangoLayout *layout;
-	layout = pango_cairo_create_layout(coordinates_cr);
+	layout = pango_cairo_create_layout(scratch_cr);
 	char font_str[32];
 	float font_size = (float) (10 * tx / 100.0f);
 	sprintf(font_str, "%s %.1f", FONT_FACE, font_size);
@@ -199,48 +262,86 @@ void draw_board_surface(int width, int height) {
 	pango_layout_set_font_description(layout, desc);
 	pango_font_description_free(desc);
 
+	// 'a' to 'h', then '1' to '8'
+	for (j = 0; j < 16; j++) {
+		coord[0] = (char) (j < 8 ? 'a' + j : '1' + j - 8);
+		pango_layout_set_text(layout, coord, 1);
+		int pix_width;
+		int pix_height;
+		pango_layout_get_pixel_size(layout, &pix_width, &pix_height);
+
+		cairo_surface_destroy(coordinate_glyphs[j]);
+		coordinate_glyphs[j] = cairo_image_surface_create(CAIRO_FORMAT_A8, pix_width, pix_height);
+		cairo_t *glyph_cr = cairo_create(coordinate_glyphs[j]);
+		pango_cairo_update_layout(glyph_cr, layout);
+		pango_cairo_show_layout(glyph_cr, layout);
+		cairo_destroy(glyph_cr);
+	}
+
+	g_object_unref(layout);
+	cairo_destroy(scratch_cr);
+	cairo_surface_destroy(scratch);
+}
+
+void draw_board_surface(int width, int height) {
+
+	int j;
+	double tx = width / 8.0;
+	double ty = height / 8.0;
+
+	bool flipped = is_board_flipped();
+
+	// Tiles and glyphs only depend on the size, the board layer doesn't
+	// change with a flip (the checker pattern is symmetric)
+	if (width != tiles_wi || height != tiles_hi || square_tiles == NULL) {
+		draw_square_tiles(tx, ty);
+		draw_coordinate_glyphs(tx);
+		tiles_wi = width;
+		tiles_hi = height;
+
+		cairo_surface_destroy(board_layer);
+		board_layer = create_layer(width, height);
+		cairo_t *cr = cairo_create(board_layer);
+		cairo_pattern_t *tiles_pattern = cairo_pattern_create_for_surface(square_tiles);
+		cairo_matrix_t matrix;
+		cairo_matrix_init_scale(&matrix, cairo_image_surface_get_width(square_tiles) / (2.0f * tx),
+		                        cairo_image_surface_get_height(square_tiles) / (2.0f * ty));
+		cairo_pattern_set_matrix(tiles_pattern, &matrix);
+		cairo_pattern_set_extend(tiles_pattern, CAIRO_EXTEND_REPEAT);
+		cairo_set_source(cr, tiles_pattern);
+		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+		cairo_paint(cr);
+		cairo_pattern_destroy(tiles_pattern);
+		cairo_destroy(cr);
+	}
+
+	reset_layer(&coordinates_layer, width, height);
+	cairo_t *coordinates_cr = cairo_create(coordinates_layer);
+
 	double padding = tx / 60.0;
-	char coord[1];
 	bool light;
 
 	// Column names
 	light = true;
-	for (j = 0; j <= 8; j++) {
-		cairo_save(coordinates_cr);
-		cairo_set_source(coordinates_cr, light ? light_square_pattern : dark_square_pattern);
-		coord[0] = (char) (flipped ? 'h' - j : 'a' + j);
-		pango_layout_set_text(layout, coord, 1);
-		int pix_width;
-		int pix_height;
-		pango_layout_get_pixel_size(layout, &pix_width, &pix_height);
-		cairo_translate(coordinates_cr, (j * tx) + padding, height - pix_height - padding);
-		pango_cairo_show_layout(coordinates_cr, layout);
-		cairo_restore(coordinates_cr);
+	for (j = 0; j < 8; j++) {
+		cairo_surface_t *glyph = coordinate_glyphs[flipped ? 7 - j : j];
+		int pix_height = cairo_image_surface_get_height(glyph);
+		cairo_set_source_rgb(coordinates_cr, light ? lr : dr, light ? lg : dg, light ? lb : db);
+		cairo_mask_surface(coordinates_cr, glyph, (j * tx) + padding, height - pix_height - padding);
 		light = !light;
 	}
 
 	// Rank numbers
 	light = true;
-	for (j = 0; j <= 8; j++) {
-		cairo_save(coordinates_cr);
-		cairo_set_source(coordinates_cr, light ? light_square_pattern : dark_square_pattern);
-		coord[0] = (char) (flipped ? '1' + j : '8' - j);
-		pango_layout_set_text(layout, coord, 1);
-		int pix_width;
-		int pix_height;
-		pango_layout_get_pixel_size(layout, &pix_width, &pix_height);
-		cairo_translate(coordinates_cr, width - pix_width - padding, (j * tx) + padding);
-		pango_cairo_show_layout(coordinates_cr, layout);
-		cairo_restore(coordinates_cr);
+	for (j = 0; j < 8; j++) {
+		cairo_surface_t *glyph = coordinate_glyphs[8 + (flipped ? j : 7 - j)];
+		int pix_width = cairo_image_surface_get_width(glyph);
+		cairo_set_source_rgb(coordinates_cr, light ? lr : dr, light ? lg : dg, light ? lb : db);
+		cairo_mask_surface(coordinates_cr, glyph, width - pix_width - padding, (j * tx) + padding);
 		light = !light;
 	}
 
-	cairo_destroy(cr);
 	cairo_destroy(coordinates_cr);
-	cairo_pattern_destroy(dark_square_pattern);
-	cairo_pattern_destroy(light_square_pattern);
-	cairo_pattern_destroy(dark_gradient_pattern);
-	cairo_pattern_destroy(light_gradient_pattern);
 }
 
 
@@ -259,7 +360,7 @@ void draw_pieces_surface(int width, int height) {
 	int i;
 
 	cairo_surface_destroy(pieces_layer);
-	pieces_layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+	pieces_layer = create_layer(width, height);
 	dc = cairo_create(pieces_layer);
 
 	double xy[2];
@@ -394,6 +495,55 @@ void restore_piece_to_surface(int width, int height, chess_piece *piece) {
 
 }
 
+/* After a castle or en-passant move the rook or the eaten pawn must go
+ * too. colour is the side that moved */
+static void update_special_move_squares(int move_result, int colour, int new_col, int new_row, int wi, int hi) {
+	if (move_result > 0 && move_result & CASTLE) {
+		int oc = -1;
+		int or = -1;
+		int nc = -1;
+		int nr = -1;
+		switch (move_result & MOVE_DETAIL_MASK) {
+			case W_CASTLE_LEFT:
+				oc = 0;
+				or = 0;
+				nc = 3;
+				nr = 0;
+				break;
+			case W_CASTLE_RIGHT:
+				oc = 7;
+				or = 0;
+				nc = 5;
+				nr = 0;
+				break;
+			case B_CASTLE_LEFT:
+				oc = 0;
+				or = 7;
+				nc = 3;
+				nr = 7;
+				break;
+			case B_CASTLE_RIGHT:
+				oc = 7;
+				or = 7;
+				nc = 5;
+				nr = 7;
+				break;
+			default:
+				// Bug if it happens
+				break;
+		}
+		update_pieces_surface_by_loc(wi, hi, oc, or, nc, nr);
+		mark_square_dirty(oc, or);
+		mark_square_dirty(nc, nr);
+	}
+
+	if (move_result > 0 && move_result & EN_PASSANT) {
+		int pawn_row = new_row + (colour ? 1 : -1);
+		kill_piece_from_surface(wi, hi, new_col, pawn_row);
+		mark_square_dirty(new_col, pawn_row);
+	}
+}
+
 void paint_layers(cairo_t *cdc) {
 	// Board
 	cairo_set_operator(cdc, CAIRO_OPERATOR_SOURCE);
@@ -419,14 +569,142 @@ void paint_layers(cairo_t *cdc) {
 //	cairo_paint(cdc);
 }
 
+// Clears all highlights. If the size is unchanged only the highlighted squares are wiped
 void init_highlight_under_surface(int wi, int hi) {
-	cairo_surface_destroy(highlight_under_layer);
-	highlight_under_layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, wi, hi);
+	if (!layer_has_size(highlight_under_layer, wi, hi)) {
+		reset_layer(&highlight_under_layer, wi, hi);
+		highlighted_squares = 0;
+		return;
+	}
+
+	if (highlighted_squares) {
+		int col, row;
+		double xy[2];
+		cairo_t *dc = cairo_create(highlight_under_layer);
+		// round outwards so that no anti-aliased edge survives
+		for (col = 0; col < 8; col++) {
+			for (row = 0; row < 8; row++) {
+				if (highlighted_squares & SQUARE_BIT(col, row)) {
+					loc_to_xy(col, row, xy, wi, hi);
+					cairo_rectangle(dc, floor(xy[0] - wi / 16.0f), floor(xy[1] - hi / 16.0f), ceil(wi / 8.0f) + 1, ceil(hi / 8.0f) + 1);
+				}
+			}
+		}
+		cairo_set_operator(dc, CAIRO_OPERATOR_CLEAR);
+		cairo_fill(dc);
+		cairo_destroy(dc);
+
+		dirty_squares |= highlighted_squares;
+		highlighted_squares = 0;
+	}
 }
 
 void init_highlight_over_surface(int wi, int hi) {
 	cairo_surface_destroy(highlight_over_layer);
-	highlight_over_layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, wi, hi);
+	highlight_over_layer = create_layer(wi, hi);
+}
+
+/* Board sized layers are created in the board window's native format
+ * unless --image-layers was given (or the window isn't realized yet) */
+static cairo_surface_t *create_layer(int wi, int hi) {
+	cairo_surface_t *layer;
+	GdkWindow *window = GTK_IS_WIDGET(board) ? gtk_widget_get_window(board) : NULL;
+
+	if (!image_layers_flag && window != NULL) {
+		layer = gdk_window_create_similar_surface(window, CAIRO_CONTENT_COLOR_ALPHA, wi, hi);
+	} else {
+		layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, wi, hi);
+	}
+	cairo_surface_set_user_data(layer, &layer_size_key, GINT_TO_POINTER((wi << 16) | hi), NULL);
+	return layer;
+}
+
+static bool layer_has_size(cairo_surface_t *layer, int wi, int hi) {
+	if (layer == NULL) {
+		return false;
+	}
+	return GPOINTER_TO_INT(cairo_surface_get_user_data(layer, &layer_size_key)) == ((wi << 16) | hi);
+}
+
+/* Reuse layer if its size is unchanged, clearing it, otherwise recreate it */
+static void reset_layer(cairo_surface_t **layer, int wi, int hi) {
+	if (layer_has_size(*layer, wi, hi)) {
+		cairo_t *dc = cairo_create(*layer);
+		cairo_set_operator(dc, CAIRO_OPERATOR_CLEAR);
+		cairo_paint(dc);
+		cairo_destroy(dc);
+		return;
+	}
+	cairo_surface_destroy(*layer);
+	*layer = create_layer(wi, hi);
+}
+
+void mark_square_dirty(int col, int row) {
+	if (col < 0 || col > 7 || row < 0 || row > 7) {
+		return;
+	}
+	dirty_squares |= SQUARE_BIT(col, row);
+}
+
+void mark_all_squares_dirty(void) {
+	dirty_squares = ALL_SQUARES;
+}
+
+/* Queue a repaint of a board area. The expose handler only recomposites
+ * the cache layer inside the invalidated area (see draw_cheap_repaint) */
+static void invalidate_rectangle(double x, double y, double w, double h) {
+	if (!GTK_IS_WIDGET(board)) {
+		return;
+	}
+	// cache layer coordinates don't match the widget while scaled
+	if (is_scaled) {
+		gtk_widget_queue_draw(board);
+		return;
+	}
+	int x0 = (int) floor(x);
+	int y0 = (int) floor(y);
+	gtk_widget_queue_draw_area(board, x0, y0, (int) ceil(x + w) - x0, (int) ceil(y + h) - y0);
+}
+
+/* Refresh the dragging background on the dirty squares and invalidate them.
+ * Must be called with the gdk lock held */
+void flush_dirty_squares(int wi, int hi) {
+	int col, row;
+	uint64_t dirty = dirty_squares;
+
+	if (!dirty) {
+		return;
+	}
+	dirty_squares = 0;
+
+	if (dragging_background != NULL) {
+		cairo_t *drag_dc = cairo_create(dragging_background);
+		for (col = 0; col < 8; col++) {
+			for (row = 0; row < 8; row++) {
+				if (dirty & SQUARE_BIT(col, row)) {
+					square_to_rectangle(drag_dc, col, row, wi, hi);
+				}
+			}
+		}
+		cairo_clip(drag_dc);
+		paint_layers(drag_dc);
+		cairo_destroy(drag_dc);
+	}
+
+	if (dirty == ALL_SQUARES) {
+		invalidate_rectangle(0, 0, wi, hi);
+		return;
+	}
+
+	double xy[2];
+	for (col = 0; col < 8; col++) {
+		for (row = 0; row < 8; row++) {
+			if (dirty & SQUARE_BIT(col, row)) {
+				loc_to_xy(col, row, xy, wi, hi);
+				invalidate_rectangle(xy[0] - wi / 16.0f, xy[1] - hi / 16.0f, wi / 8.0f, hi / 8.0f);
+			}
+		}
+	}
 }
 
 void draw_full_update(cairo_t *cdr, int wi, int hi) {
@@ -435,7 +713,9 @@ void draw_full_update(cairo_t *cdr, int wi, int hi) {
 	draw_pieces_surface(wi, hi);
 
 	// Re-highlight highlighted square if any
-	init_highlight_under_surface(wi, hi);
+	// NB: highlighted squares may have moved (flip), so wipe the whole layer
+	reset_layer(&highlight_under_layer, wi, hi);
+	highlighted_squares = 0;
 	if (mouse_clicked[0] >= 0 || king_in_check_piece != NULL) {
 		cairo_t *high_cr = cairo_create(highlight_under_layer);
 		if (mouse_clicked[0] >= 0) {
@@ -464,8 +744,10 @@ void draw_full_update(cairo_t *cdr, int wi, int hi) {
 	old_wi = wi;
 	old_hi = hi;
 
-	cairo_surface_destroy(cache_layer);
-	cache_layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, wi, hi);
+	// Everything is recomposited below
+	dirty_squares = 0;
+
+	reset_layer(&cache_layer, wi, hi);
 	cairo_t *cache_cr = cairo_create(cache_layer);
 	paint_layers(cache_cr);
 	if (mouse_dragged_piece != NULL && is_moveit_flag()) {
@@ -484,6 +766,91 @@ void draw_full_update(cairo_t *cdr, int wi, int hi) {
 	is_scaled = false;
 }
 
+/* Offscreen rendering: compose the whole position into target, with
+ * every layer rebuilt at the given size. No window is needed */
+void render_position(cairo_t *target, int wi, int hi) {
+	needs_update = 1;
+	draw_full_update(target, wi, hi);
+}
+
+/* Board and coordinates without any piece, as a new image surface */
+cairo_surface_t *render_empty_board(int wi, int hi) {
+	draw_board_surface(wi, hi);
+
+	cairo_surface_t *surf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, wi, hi);
+	cairo_t *cr = cairo_create(surf);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cr, board_layer, 0.0f, 0.0f);
+	cairo_paint(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	cairo_set_source_surface(cr, coordinates_layer, 0.0f, 0.0f);
+	cairo_paint(cr);
+	cairo_destroy(cr);
+	return surf;
+}
+
+/* Offscreen counterpart of a non animated move: bring the layers up to
+ * date after piece moved from old_col, old_row and recomposite only the
+ * touched squares into target. The layers must be at wi, hi already */
+void render_move(cairo_t *target, chess_piece *piece, int old_col, int old_row, int move_result, int wi, int hi) {
+	int col, row;
+
+	// promotions swap the sprite
+	piece->surf = piece_surfaces[piece->type];
+
+	update_pieces_surface(wi, hi, old_col, old_row, piece);
+	mark_square_dirty(old_col, old_row);
+	mark_square_dirty(piece->pos.column, piece->pos.row);
+	update_special_move_squares(move_result, piece->colour, piece->pos.column, piece->pos.row, wi, hi);
+
+	init_highlight_under_surface(wi, hi);
+	if (highlight_last_move) {
+		highlight_move(old_col, old_row, piece->pos.column, piece->pos.row, wi, hi);
+	}
+	if (is_king_checked(main_game, main_game->whose_turn)) {
+		warn_check(wi, hi);
+	} else {
+		king_in_check_piece = NULL;
+	}
+
+	cairo_save(target);
+	for (col = 0; col < 8; col++) {
+		for (row = 0; row < 8; row++) {
+			if (dirty_squares & SQUARE_BIT(col, row)) {
+				square_to_rectangle(target, col, row, wi, hi);
+			}
+		}
+	}
+	cairo_clip(target);
+	flush_dirty_squares(wi, hi);
+	draw_cheap_repaint(target, wi, hi);
+	cairo_restore(target);
+}
+
+/* Redraw the pieces after main_game jumped to another position, e.g. when
+ * browsing the moves list. last_move may be NULL. Must be called with the
+ * GDK lock held */
+void show_position(int last_move[4], int wi, int hi) {
+	mouse_clicked_piece = NULL;
+	mouse_clicked[0] = -1;
+	mouse_clicked[1] = -1;
+
+	assign_surfaces();
+	draw_pieces_surface(wi, hi);
+	init_highlight_under_surface(wi, hi);
+	if (last_move != NULL && highlight_last_move) {
+		highlight_move(last_move[0], last_move[1], last_move[2], last_move[3], wi, hi);
+	}
+	if (is_king_checked(main_game, main_game->whose_turn)) {
+		warn_check(wi, hi);
+	} else {
+		king_in_check_piece = NULL;
+	}
+
+	mark_all_squares_dirty();
+	flush_dirty_squares(wi, hi);
+}
+
 void draw_scaled(cairo_t *cdr, int wi, int hi) {
 	// This is the whole point of having the cache layer:
 	// For some reason it is *A LOT* quicker to rescale
@@ -503,19 +870,26 @@ void draw_scaled(cairo_t *cdr, int wi, int hi) {
 
 void draw_cheap_repaint(cairo_t *cdr, int wi, int hi) {
 
-	// Just redraw layers
-	cairo_t *cache_cr = cairo_create(cache_layer);
-
 	if (is_scaled) {
 		w_ratio = wi / ((double) old_wi);
 		h_ratio = hi / ((double) old_hi);
 		cairo_scale(cdr, w_ratio, h_ratio);
 	}
 
-	paint_layers(cache_cr);
+	// Just redraw the damaged area. The dragging background holds all
+	// layers plus animated pieces, minus the piece being dragged
+	double x1, y1, x2, y2;
+	cairo_clip_extents(cdr, &x1, &y1, &x2, &y2);
+
+	cairo_t *cache_cr = cairo_create(cache_layer);
+	cairo_rectangle(cache_cr, floor(x1), floor(y1), ceil(x2) - floor(x1), ceil(y2) - floor(y1));
+	cairo_clip(cache_cr);
+
+	cairo_set_operator(cache_cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cache_cr, dragging_background, 0.0f, 0.0f);
+	cairo_paint(cache_cr);
 
 	if (mouse_dragged_piece != NULL && is_moveit_flag()) {
-		debug("Dragged while resetting!\n");
 		double dragged_x, dragged_y;
 		get_dragging_prev_xy(&dragged_x, &dragged_y);
 		cairo_set_source_surface (cache_cr, mouse_dragged_piece->surf, dragged_x-wi/16.0f, dragged_y-hi/16.0f);
@@ -643,430 +1017,158 @@ void clean_highlight_surface(int col, int row, int wi, int hi) {
 	cairo_clip(highlight);
 	cairo_paint(highlight);
 	cairo_destroy(highlight);
+
+	highlighted_squares &= ~SQUARE_BIT(col, row);
+	mark_square_dirty(col, row);
+}
+
+/* Ease-in from start, ease-out to end, through mid (t in [0, 1]) */
+static void anim_position(struct anim_data *anim, double t, double xy[2]) {
+	double e;
+	if (t < 0.5f) {
+		e = ease_lookup(2.0f * t);
+		xy[0] = anim->start[0] + (anim->mid[0] - anim->start[0]) * e;
+		xy[1] = anim->start[1] + (anim->mid[1] - anim->start[1]) * e;
+	} else {
+		e = 1.0f - ease_lookup(2.0f - 2.0f * t);
+		xy[0] = anim->mid[0] + (anim->end[0] - anim->mid[0]) * e;
+		xy[1] = anim->mid[1] + (anim->end[1] - anim->mid[1]) * e;
+	}
+}
+
+/* Repaint an area of the dragging background from the layers and queue it */
+static void clean_anim_step(double x, double y, double ww, double hh) {
+	cairo_t *dragging_dc = cairo_create(dragging_background);
+	cairo_rectangle(dragging_dc, floor(x), floor(y), ceil(ww), ceil(hh));
+	cairo_clip(dragging_dc);
+	paint_layers(dragging_dc);
+	cairo_destroy(dragging_dc);
+	invalidate_rectangle(x, y, ww, hh);
 }
 
-static gboolean animate_one_step(gpointer data) {
+/* Frame clock callback, one per running animation. The piece position is
+ * a function of the frame time, so a late frame skips ahead instead of
+ * slowing the animation down. NB: runs with the gdk lock held */
+static gboolean animate_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer data) {
 
 	if (!is_running_flag()) {
-		return FALSE;
+		return G_SOURCE_REMOVE;
 	}
 
-	double step_x, step_y;
-	double prev_x, prev_y;
-
 	struct anim_data *anim = (struct anim_data *)data;
 
 	double wi = (double) gtk_widget_get_allocated_width(board);
 	double hi = (double) gtk_widget_get_allocated_height(board);
 
-	step_x = anim->plots[anim->step_index][0];
-	step_y = anim->plots[anim->step_index][1];
-	prev_x = anim->plots[anim->step_index-1][0];
-	prev_y = anim->plots[anim->step_index-1][1];
-
 	double ww = wi/8.0f;
 	double hh = hi/8.0f;
 
+	gint64 now = gdk_frame_clock_get_frame_time(frame_clock);
+
 	// First step, remove piece surface from pieces_layer
-	if (anim->step_index < 2) {
+	if (anim->start_time == 0) {
+		anim->start_time = now;
 		kill_piece_from_surface(wi, hi, anim->old_col, anim->old_row);
 	}
 
-	// Animation was killed, find out why
-	if (anim->killed_by || anim->piece->dead) {
-		if (anim->piece->dead) {
-			debug("Piece was killed while being animated! killed by %d\n", anim->killed_by);
-		}
-
-		gdk_threads_enter();
-		// handle promote
-		if (anim->move_result > 0 && anim->move_result & PROMOTE && anim->move_source == AUTO_SOURCE) {
-			debug("Promote from killed anim\n");
-			to_promote = anim->piece;
-			delay_from_promotion = false;
-			choose_promote(anim->promo_type, TRUE, false, anim->old_col, anim->old_row, anim->new_col, anim->new_row);
-		}
-
-		// clean last step from dragging background
-		cairo_t *dragging_dc = cairo_create(dragging_background);
-		cairo_save(dragging_dc);
-		cairo_rectangle(dragging_dc, floor(prev_x - wi / 16), floor(prev_y - hi / 16), ceil(ww), ceil(hh));
-		cairo_clip(dragging_dc);
-		paint_layers(dragging_dc);
-
-		// paint buffer surface with dragging background
-		cairo_t *cache_dc = cairo_create(cache_layer);
-		cairo_save(cache_dc);
-		cairo_set_source_surface(cache_dc, dragging_background, 0.0f, 0.0f);
-		cairo_rectangle(cache_dc, floor(prev_x - wi / 16), floor(prev_y - hi / 16), ceil(ww), ceil(hh));
-		cairo_clip(cache_dc);
-		cairo_paint(cache_dc);
-
-		cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-		cairo_rectangle(cdr, floor(prev_x - wi / 16), floor(prev_y - hi / 16), ceil(ww), ceil(hh));
-
-		// In case anim was killed by other animated piece taking it or
-		// new anim, repaint piece on its would have been destination
-		if (anim->killed_by == KILLED_BY_OTHER_ANIMATION_TAKING ||
-		    anim->killed_by == KILLED_BY_OTHER_ANIMATION_SAME_PIECE) {
-			debug("Animation was %s!\n",
-			      (anim->killed_by == KILLED_BY_OTHER_ANIMATION_TAKING ? "KILLED_BY_OTHER_ANIMATION_TAKING"
-			                                                           : "KILLED_BY_OTHER_ANIMATION_SAME_PIECE"));
-			double killed_xy[2];
-			cairo_restore(dragging_dc);
-			loc_to_xy(anim->new_col, anim->new_row, killed_xy, wi, hi);
-			cairo_rectangle(dragging_dc, floor(killed_xy[0] - wi / 16), floor(killed_xy[1] - hi / 16), ceil(ww), ceil(hh));
-			cairo_clip(dragging_dc);
-			cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
-			cairo_set_source_surface(dragging_dc, board_layer, 0.0f, 0.0f);
-			cairo_paint(dragging_dc);
-			cairo_set_operator(cdr, CAIRO_OPERATOR_OVER);
-			cairo_set_source_surface(dragging_dc, highlight_under_layer, 0.0f, 0.0f);
-			cairo_paint(dragging_dc);
-			cairo_set_source_surface(dragging_dc, coordinates_layer, 0.0f, 0.0f);
-			cairo_paint(dragging_dc);
-			cairo_set_source_surface(dragging_dc, anim->piece->surf, killed_xy[0] - wi / 16, killed_xy[1] - hi / 16);
-			cairo_paint(dragging_dc);
-
-			// debug
-//			cairo_set_source_rgba (dragging_dc, 1, 0, 0, .5f);
-//			cairo_paint(dragging_dc);
-
-			cairo_restore(cache_dc);
-			cairo_save(cache_dc);
-			cairo_rectangle(cache_dc, floor(killed_xy[0] - wi / 16), floor(killed_xy[1] - hi / 16), ceil(ww), ceil(hh));
-			cairo_clip(cache_dc);
-			cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
-			cairo_set_source_surface(cache_dc, dragging_background, 0, 0);
-			cairo_paint(cache_dc);
-			cairo_restore(cache_dc);
-			cairo_rectangle(cdr, floor(killed_xy[0] - wi / 16), floor(killed_xy[1] - hi / 16), ceil(ww), ceil(hh));
-		}
-
-		// If a piece is being dragged and overlaps with the animation, repaint the dragged piece above to cache layer
-		if (mouse_dragged_piece != NULL && is_moveit_flag()) {
-			double dragged_x, dragged_y;
-			get_dragging_prev_xy(&dragged_x, &dragged_y);
-			//FIXME: better lock access to mouse_dragged_piece (this could segfault otherwise)
-			cairo_set_source_surface(cache_dc, mouse_dragged_piece->surf, dragged_x - wi / 16.0f,
-			                         dragged_y - hi / 16.0f);
-			cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
-			cairo_paint(cache_dc);
-		}
-
-		cairo_destroy(dragging_dc);
-		cairo_destroy(cache_dc);
-
-		cairo_clip(cdr);
-
-		// apply buffered surface to cr (NB: cr is clipped)
-		cairo_set_operator(cdr, CAIRO_OPERATOR_OVER);
-		cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-		cairo_paint(cdr);
-
-		// debug
-//			cairo_set_source_rgba (cdr, 1, 0, 0, .5f);
-//			cairo_paint(cdr);
-
-		cairo_destroy(cdr);
-		/* LEAVE THREADS */
-		gdk_threads_leave();
-
-		if (anim->killed_by != KILLED_BY_OTHER_ANIMATION_SAME_PIECE) {
-			g_hash_table_remove(anims_map, anim->piece);
-		}
-		free_anim_data(anim);
-		return FALSE;
-	}
-
-	/* ENTER THREADS */
-	gdk_threads_enter();
-
-	// clean last step from dragging background - [added since we now paint to dragging_layer]
-	cairo_t *dragging_dc = cairo_create(dragging_background);
-	cairo_save(dragging_dc);
-	cairo_rectangle(dragging_dc, floor(prev_x - wi / 16), floor(prev_y - hi / 16), ceil(ww), ceil(hh));
-	cairo_clip(dragging_dc);
-	paint_layers(dragging_dc);
-	// debug
-//	cairo_set_source_rgba (dragging_dc, 1, 0, 0, .3f);
-//	cairo_paint(dragging_dc);
-
-	// paint piece on it - [added since we now paint to dragging_layer]
-	cairo_restore(dragging_dc);
-	cairo_set_source_surface(dragging_dc, anim->piece->surf, step_x-wi/16, step_y-hi/16);
-	cairo_rectangle(dragging_dc, floor(step_x-wi/16), floor(step_y-hi/16), ceil(ww), ceil(hh));
-	cairo_clip(dragging_dc);
-	cairo_paint(dragging_dc);
-
-	// debug
-//	cairo_set_source_rgba (dragging_dc, 0, 0, 1, .5f);
-//	cairo_rectangle(dragging_dc, floor(step_x-wi/16), floor(step_y-hi/16), ceil(ww), ceil(hh));
-//	cairo_set_line_width(dragging_dc, 1);
-//	cairo_stroke(dragging_dc);
-//	cairo_paint(dragging_dc);
-
-	cairo_destroy(dragging_dc);
-
-	// paint buffer surface with dragging background
-	cairo_t *cache_dc = cairo_create(cache_layer);
-	cairo_set_source_surface (cache_dc, dragging_background, 0.0f, 0.0f);
-	cairo_rectangle(cache_dc, floor(prev_x-wi/16), floor(prev_y-hi/16), ceil(ww), ceil(hh));
-	cairo_rectangle(cache_dc, floor(step_x-wi/16), floor(step_y-hi/16), ceil(ww), ceil(hh));
-	cairo_clip(cache_dc);
-	cairo_paint(cache_dc);
-
-	// paint animated piece at new position - [removed since we now paint to dragging_layer]
-	//	cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
-	//	cairo_set_source_surface (cache_dc, anim->piece->surf, step_x-wi/16.0f, step_y-hi/16.0f);
-	//	cairo_paint(cache_dc);
-
-	// If a piece is being dragged and overlaps with the animation, repaint the dragged piece above to cache layer
-	if (mouse_dragged_piece != NULL && is_moveit_flag()) {
-		double dragged_x, dragged_y;
-		get_dragging_prev_xy(&dragged_x, &dragged_y);
-		//FIXME: better lock access to mouse_dragged_piece (this could segfault otherwise)
-		cairo_set_source_surface (cache_dc, mouse_dragged_piece->surf, dragged_x-wi/16.0f, dragged_y-hi/16.0f);
-		cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
-		cairo_paint(cache_dc);
-	}
-
-	cairo_destroy(cache_dc);
-
-
-	// If the board isn't drawable we're probably exiting
-	// free up allocated memory and stop animation
-	if (gdk_window_is_destroyed(gtk_widget_get_window(board))) {
-		debug("Aborting animation.\n");
-		free_anim_data(anim);
-		gdk_threads_leave();
-		return FALSE;
-	}
-	cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-	cairo_rectangle(cdr, floor(step_x-wi/16.0f), floor(step_y-hi/16.0f), ceil(ww), ceil(hh));
-	cairo_rectangle(cdr, floor(prev_x-wi/16.0f), floor(prev_y-hi/16.0f), ceil(ww), ceil(hh));
-	cairo_clip(cdr);
-
-	// apply buffered surface to cr (NB: cr is clipped)
-	cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
-	cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-	cairo_paint(cdr);
-
-	// debug
-//	cairo_set_operator (cdr, CAIRO_OPERATOR_OVER);
-//	cairo_set_source_rgba (cdr, 1, 0, 0, .3f);
-//	cairo_paint(cdr);
-
-	cairo_destroy(cdr);
-
-	anim->step_index++;
-	if (anim->step_index >= anim->n_plots) { // final step
-
-		// clean last step from dragging background
-		cairo_t *dragging_dc = cairo_create(dragging_background);
-		cairo_rectangle(dragging_dc, floor(step_x-wi/16), floor(step_y-hi/16), ceil(ww), ceil(hh));
-		cairo_clip(dragging_dc);
-		paint_layers(dragging_dc);
-		cairo_destroy(dragging_dc);
-
-		// handle special moves and eaten pieces now
-
-		update_pieces_surface(wi, hi, anim->old_col, anim->old_row, anim->piece);
-
-		cairo_t *cache_dc = cairo_create(cache_layer);
-
-		// repaint destination square
-		cairo_rectangle(cache_dc, floor(step_x-wi/16.0f), floor(step_y-hi/16.0f), ceil(ww), ceil(hh));
-		cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
-		cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
-		cairo_fill_preserve(cache_dc);
-		cairo_set_operator (cache_dc, CAIRO_OPERATOR_OVER);
-		cairo_set_source_surface(cache_dc, highlight_under_layer, 0.0f, 0.0f);
-		cairo_fill_preserve(cache_dc);
-		cairo_set_source_surface(cache_dc, coordinates_layer, 0.0f, 0.0f);
-		cairo_fill_preserve(cache_dc);
-		cairo_set_source_surface(cache_dc, pieces_layer, 0.0f, 0.0f);
-
-		// If a piece is being dragged and overlaps with the animation final step
-		// repaint the dragged piece above to cache layer
-		if (mouse_dragged_piece != NULL && is_moveit_flag()) {
-			cairo_fill_preserve(cache_dc);
-			double dragged_x, dragged_y;
-			get_dragging_prev_xy(&dragged_x, &dragged_y);
-			//FIXME: better lock access to mouse_dragged_piece (this could segfault otherwise)
-			cairo_set_source_surface (cache_dc, mouse_dragged_piece->surf, dragged_x-wi/16.0f, dragged_y-hi/16.0f);
-			cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
-		}
-		cairo_fill(cache_dc);
-
-		// if was castle move, handle rook
-		int oc = -1;
-		int or = -1;
-		int nc = -1;
-		int nr = -1;
-		double rook_xy[2];
-		if (anim->move_result > 0 && anim->move_result & CASTLE) {
-			switch (anim->move_result & MOVE_DETAIL_MASK) {
-				case W_CASTLE_LEFT:
-					oc = 0;
-					or = 0;
-					nc = 3;
-					nr = 0;
-					break;
-				case W_CASTLE_RIGHT:
-					oc = 7;
-					or = 0;
-					nc = 5;
-					nr = 0;
-					break;
-				case B_CASTLE_LEFT:
-					oc = 0;
-					or = 7;
-					nc = 3;
-					nr = 7;
-					break;
-				case B_CASTLE_RIGHT:
-					oc = 7;
-					or = 7;
-					nc = 5;
-					nr = 7;
-					break;
-				default:
-					// Bug if it happens
-					break;
-			}
-			update_pieces_surface_by_loc(wi, hi, oc, or, nc, nr);
-
-			// repaint rook source square
-			loc_to_xy(oc, or, rook_xy, wi, hi);
-			cairo_rectangle(cache_dc, rook_xy[0]-wi/16.0f, rook_xy[1]-hi/16.0f, ww, hh);
-			cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
-			cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
-			cairo_fill_preserve(cache_dc);
-			cairo_set_operator (cache_dc, CAIRO_OPERATOR_OVER);
-			cairo_set_source_surface(cache_dc, coordinates_layer, 0.0f, 0.0f);
-			//cairo_fill(cache_dc);
-			// If a piece is being dragged and overlaps with the animation final step
-			// repaint the dragged piece above to cache layer
-			if (mouse_dragged_piece != NULL && is_moveit_flag()) {
-				cairo_fill_preserve(cache_dc);
-				double dragged_x, dragged_y;
-				get_dragging_prev_xy(&dragged_x, &dragged_y);
-				//FIXME: better lock access to mouse_dragged_piece (this could segfault otherwise)
-				cairo_set_source_surface (cache_dc, mouse_dragged_piece->surf, dragged_x-wi/16.0f, dragged_y-hi/16.0f);
-				cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
-				cairo_fill(cache_dc);
-			}
-			else {
-				cairo_fill(cache_dc);
-			}
-
-			// repaint rook destination square
-			loc_to_xy(nc, nr, rook_xy, wi, hi);
-			cairo_rectangle(cache_dc, rook_xy[0] - wi / 16.0f, rook_xy[1] - hi / 16.0f, ww, hh);
-			cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
-			cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
-			cairo_fill_preserve(cache_dc);
-			cairo_set_operator (cache_dc, CAIRO_OPERATOR_OVER);
-			cairo_set_source_surface(cache_dc, coordinates_layer, 0.0f, 0.0f);
-			cairo_fill_preserve(cache_dc);
-			cairo_set_source_surface(cache_dc, pieces_layer, 0.0f, 0.0f);
-
-			//cairo_fill(cache_dc);
-			// If a piece is being dragged and overlaps with the animation final step
-			// repaint the dragged piece above to cache layer
-			if (mouse_dragged_piece != NULL && is_moveit_flag()) {
-				cairo_fill_preserve(cache_dc);
-				double dragged_x, dragged_y;
-				get_dragging_prev_xy(&dragged_x, &dragged_y);
-				//FIXME: better lock access to mouse_dragged_piece (this could segfault otherwise)
-				cairo_set_source_surface (cache_dc, mouse_dragged_piece->surf, dragged_x-wi/16.0f, dragged_y-hi/16.0f);
-				cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
-				cairo_fill(cache_dc);
-			}
-			else {
-				cairo_fill(cache_dc);
-			}
-
-		}
+	double prev_x = anim->prev[0];
+	double prev_y = anim->prev[1];
 
-		// handle en-passant
-		double pawn_xy[2];
-		if (anim->move_result > 0 && anim->move_result & EN_PASSANT) {
-			loc_to_xy(anim->new_col, anim->new_row + (anim->piece->colour ? 1 : -1), pawn_xy, wi, hi);
-			// repaint square where eaten pawn was
-			cairo_rectangle(cache_dc, pawn_xy[0]-wi/16.0f, pawn_xy[1]-hi/16.0f, ww, hh);
-			cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
-
-			cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
-			cairo_fill(cache_dc);
-			// DEBUG
-			//cairo_rectangle(cache_dc, pawn_xy[0]-wi/16.0f, pawn_xy[1]-hi/16.0f, ww, hh);
-			//cairo_set_source_rgba(cache_dc, 1, 0, 0, .7f);
-			//cairo_set_operator (cache_dc, CAIRO_OPERATOR_OVER);
-			//cairo_fill(cache_dc);
-
-			kill_piece_from_surface(wi, hi, anim->new_col, anim->new_row + (anim->piece->colour ? 1 : -1));
+	// Animation was killed, find out why
+	if (anim->killed_by || anim->piece->dead) {
+		if (anim->piece->dead) {
+			debug("Piece was killed while being animated! killed by %d\n", anim->killed_by);
 		}
 
 		// handle promote
 		if (anim->move_result > 0 && anim->move_result & PROMOTE && anim->move_source == AUTO_SOURCE) {
-			debug("Promote from anim last step\n");
+			debug("Promote from killed anim\n");
 			to_promote = anim->piece;
 			delay_from_promotion = false;
-			choose_promote(anim->promo_type, true, false, anim->old_col, anim->old_row, anim->new_col, anim->new_row);
+			choose_promote(anim->promo_type, TRUE, false, anim->old_col, anim->old_row, anim->new_col, anim->new_row);
 		}
 
-		cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-
-		// destroy buffer drawing context
-		cairo_destroy(cache_dc);
+		// clean last step from dragging background
+		clean_anim_step(prev_x - wi / 16, prev_y - hi / 16, ww, hh);
 
-		// clip cr to repaint only needed squares
-		cairo_rectangle(cdr, floor(step_x-wi/16.0f), floor(step_y-hi/16.0f), ceil(ww), ceil(hh));
-		// Add special clipping squares in case of castling
-		if (anim->move_result > 0 && anim->move_result & CASTLE) {
-			loc_to_xy(oc, or, rook_xy, wi, hi);
-			cairo_rectangle(cdr, floor(rook_xy[0]-wi/16.0f), floor(rook_xy[1]-hi/16.0f), ceil(ww), ceil(hh));
-			loc_to_xy(nc, nr, rook_xy, wi, hi);
-			cairo_rectangle(cdr, floor(rook_xy[0]-wi/16.0f), floor(rook_xy[1]-hi/16.0f), ceil(ww), ceil(hh));
+		// In case anim was killed by other animated piece taking it or
+		// new anim, repaint piece on its would have been destination
+		if (anim->killed_by == KILLED_BY_OTHER_ANIMATION_TAKING ||
+		    anim->killed_by == KILLED_BY_OTHER_ANIMATION_SAME_PIECE) {
+			debug("Animation was %s!\n",
+			      (anim->killed_by == KILLED_BY_OTHER_ANIMATION_TAKING ? "KILLED_BY_OTHER_ANIMATION_TAKING"
+			                                                           : "KILLED_BY_OTHER_ANIMATION_SAME_PIECE"));
+			double killed_xy[2];
+			loc_to_xy(anim->new_col, anim->new_row, killed_xy, wi, hi);
+			cairo_t *dragging_dc = cairo_create(dragging_background);
+			cairo_rectangle(dragging_dc, floor(killed_xy[0] - wi / 16), floor(killed_xy[1] - hi / 16), ceil(ww), ceil(hh));
+			cairo_clip(dragging_dc);
+			cairo_set_operator(dragging_dc, CAIRO_OPERATOR_SOURCE);
+			cairo_set_source_surface(dragging_dc, board_layer, 0.0f, 0.0f);
+			cairo_paint(dragging_dc);
+			cairo_set_operator(dragging_dc, CAIRO_OPERATOR_OVER);
+			cairo_set_source_surface(dragging_dc, highlight_under_layer, 0.0f, 0.0f);
+			cairo_paint(dragging_dc);
+			cairo_set_source_surface(dragging_dc, coordinates_layer, 0.0f, 0.0f);
+			cairo_paint(dragging_dc);
+			cairo_set_source_surface(dragging_dc, anim->piece->surf, killed_xy[0] - wi / 16, killed_xy[1] - hi / 16);
+			cairo_paint(dragging_dc);
+			cairo_destroy(dragging_dc);
+			invalidate_rectangle(killed_xy[0] - wi / 16, killed_xy[1] - hi / 16, ww, hh);
 		}
 
-		// Add special clipping squares in case of en-passant
-		if (anim->move_result > 0 && anim->move_result & EN_PASSANT) {
-			loc_to_xy(anim->new_col, anim->new_row + (anim->piece->colour ? 1 : -1), pawn_xy, wi, hi);
-			cairo_rectangle(cdr, floor(pawn_xy[0]-wi/16.0f), floor(pawn_xy[1]-hi/16.0f), ceil(ww), ceil(hh));
+		if (anim->killed_by != KILLED_BY_OTHER_ANIMATION_SAME_PIECE) {
+			g_hash_table_remove(anims_map, anim->piece);
 		}
+		return G_SOURCE_REMOVE;
+	}
 
-		// Actual clip
-		cairo_clip(cdr);
+	double t = (double) (now - anim->start_time) / (double) anim->duration;
 
-		cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-		cairo_set_operator (cdr, CAIRO_OPERATOR_OVER);
-		//cairo_set_operator (cdr, CAIRO_OPERATOR_SOURCE);
-		cairo_paint(cdr);
+	if (t < 1.0f) {
+		double step[2];
+		anim_position(anim, t, step);
 
-		// debug : uncomment the following to highlight repainted areas
-//		cairo_set_source_rgba (cdr, 0.0f, 1.0f, 0.0f, .75f);
-//		cairo_paint(cdr);
+		// clean last step from dragging background
+		clean_anim_step(prev_x - wi / 16, prev_y - hi / 16, ww, hh);
 
-		cairo_destroy(cdr);
+		// paint piece on it at its new position
+		cairo_t *dragging_dc = cairo_create(dragging_background);
+		cairo_set_source_surface(dragging_dc, anim->piece->surf, step[0]-wi/16, step[1]-hi/16);
+		cairo_rectangle(dragging_dc, floor(step[0]-wi/16), floor(step[1]-hi/16), ceil(ww), ceil(hh));
+		cairo_clip(dragging_dc);
+		cairo_paint(dragging_dc);
+		cairo_destroy(dragging_dc);
+		invalidate_rectangle(step[0] - wi / 16, step[1] - hi / 16, ww, hh);
 
-		restore_dragging_background(anim->piece, anim->move_result, wi, hi);
+		anim->prev[0] = step[0];
+		anim->prev[1] = step[1];
+		return G_SOURCE_CONTINUE;
+	}
 
-		/* LEAVE THREADS */
-		gdk_threads_leave();
+	// final step: handle special moves and eaten pieces now
+	update_pieces_surface(wi, hi, anim->old_col, anim->old_row, anim->piece);
+	mark_square_dirty(anim->new_col, anim->new_row);
 
-		if (!anim->killed_by) {
-			g_hash_table_remove(anims_map, anim->piece);
-		}
-		free_anim_data(anim);
-		return FALSE;
+	// if was castle or en-passant move, handle rook or eaten pawn
+	update_special_move_squares(anim->move_result, anim->piece->colour, anim->new_col, anim->new_row, wi, hi);
+
+	// handle promote
+	if (anim->move_result > 0 && anim->move_result & PROMOTE && anim->move_source == AUTO_SOURCE) {
+		debug("Promote from anim last step\n");
+		to_promote = anim->piece;
+		delay_from_promotion = false;
+		choose_promote(anim->promo_type, true, false, anim->old_col, anim->old_row, anim->new_col, anim->new_row);
 	}
-	/* LEAVE THREADS */
-	gdk_threads_leave();
-	return TRUE;
 
+	// last step may straddle several squares
+	clean_anim_step(prev_x - wi / 16, prev_y - hi / 16, ww, hh);
+	flush_dirty_squares(wi, hi);
+
+	if (!anim->killed_by) {
+		g_hash_table_remove(anims_map, anim->piece);
+	}
+	return G_SOURCE_REMOVE;
 }
 
 void highlight_pre_move(int pre_move[4], int wi, int hi) {
@@ -1129,28 +1231,10 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 
 		mouse_dragged_piece = NULL;
 
-		// repaint square from last dragging step
-		cairo_t *cache_dc = cairo_create(cache_layer);
-		clean_last_drag_step(cache_dc, wi, hi);
-		cairo_destroy(cache_dc);
-
-		cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-
-		double ww = wi/8.0f;
-		double hh = hi/8.0f;
-
+		// repaint area from last dragging step
 		double dragged_x, dragged_y;
 		get_dragging_prev_xy(&dragged_x, &dragged_y);
-
-		// clip cr to repaint only needed square
-		cairo_rectangle(cdr, floor(dragged_x - wi / 16.0f), floor(dragged_y - hi / 16.0f), ceil(ww), ceil(hh));
-
-		// Actual clip
-		cairo_clip(cdr);
-
-		cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-		cairo_set_operator (cdr, CAIRO_OPERATOR_OVER);
-		cairo_paint(cdr);
+		invalidate_rectangle(dragged_x - 1 - wi / 16.0f, dragged_y - 1 - hi / 16.0f, wi / 8.0f + 2, hi / 8.0f + 2);
 
 		if (lock_threads) {
 			gdk_threads_leave();
@@ -1211,17 +1295,8 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 			update_eco_tag(lock_threads);
 		}
 
-		// Show check warning
-		double king_xy[2];
-		double old_king_xy[2];
-		double ww = wi / 8.0;
-		double hh = hi / 8.0;
-
-		chess_piece *clean_old_check = king_in_check_piece;
-		cairo_t *cache_dc = cairo_create(cache_layer);
-		cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-
 		// Clean up all highlights after a successful move
+		// (this marks the previously highlighted squares dirty)
 		if (lock_threads) {
 			gdk_threads_enter();
 		}
@@ -1229,67 +1304,17 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 //		init_highlight_over_surface(wi, hi);
 
 		if (highlight_last_move) {
-			cairo_save(cache_dc);
-
-			cairo_t *drag_cr = cairo_create(dragging_background);
-			if (prev_highlighted_move[0] > -1) {
-				// Clip to clean previous last move
-				squares_for_move(drag_cr, prev_highlighted_move, wi, hi);
-				squares_for_move(cache_dc, prev_highlighted_move, wi, hi);
-				squares_for_move(cdr, prev_highlighted_move, wi, hi);
-			}
-
-			// paint to highlight layer
 			highlight_move(old_col, old_row, new_col, new_row, wi, hi);
-
-			// update cache surface (used for scaling)
-			square_to_rectangle(cache_dc, old_col, old_row, wi, hi);
-			square_to_rectangle(cache_dc, new_col, new_row, wi, hi);
-			cairo_clip(cache_dc);
-			paint_layers(cache_dc);
-			cairo_restore(cache_dc);
-
-			// update dragging surface
-			square_to_rectangle(drag_cr, old_col, old_row, wi, hi);
-			square_to_rectangle(drag_cr, new_col, new_row, wi, hi);
-			cairo_clip(drag_cr);
-			paint_layers(drag_cr);
-			cairo_destroy(drag_cr);
-
-			// Clip to show last move
-			square_to_rectangle(cdr, old_col, old_row, wi, hi);
-			square_to_rectangle(cdr, new_col, new_row, wi, hi);
 		}
 
-		bool king_is_checked = is_king_checked(main_game, main_game->whose_turn);
-		if (king_is_checked) {
+		// Show check warning
+		if (is_king_checked(main_game, main_game->whose_turn)) {
 			warn_check(wi, hi);
-
-			loc_to_xy(king_in_check_piece->pos.column, king_in_check_piece->pos.row, king_xy, wi, hi);
-			cairo_save(cache_dc);
-			cairo_rectangle(cache_dc, king_xy[0] - wi / 16.0f, king_xy[1] - hi / 16.0f, ww, hh);
-			cairo_clip(cache_dc);
-			paint_layers(cache_dc);
-			cairo_restore(cache_dc);
-			cairo_rectangle(cdr, floor(king_xy[0] - wi / 16.0f), floor(king_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
 		} else {
 			king_in_check_piece = NULL;
 		}
 
-		if (clean_old_check != NULL && clean_old_check != piece) {
-			loc_to_xy(clean_old_check->pos.column, clean_old_check->pos.row, old_king_xy, wi, hi);
-			cairo_rectangle(cache_dc, old_king_xy[0] - wi / 16.0f, old_king_xy[1] - hi / 16.0f, ww, hh);
-			cairo_clip(cache_dc);
-			paint_layers(cache_dc);
-			cairo_rectangle(cdr, floor(old_king_xy[0] - wi / 16.0f), floor(old_king_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
-		}
-		cairo_destroy(cache_dc);
-
-		cairo_clip(cdr);
-		cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-		cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
-		cairo_paint(cdr);
-		cairo_destroy(cdr);
+		flush_dirty_squares(wi, hi);
 		if (lock_threads) {
 			gdk_threads_leave();
 		}
@@ -1332,19 +1357,8 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 		points_to_plot *= 2.0f;
 //		points_to_plot /= 3.0f;
 
-		double **anim_steps;
-		// this will be freed when we free the anim structure!
-
-		anim_steps = malloc(ANIM_SIZE*sizeof(int*));
-		int i;
-		for (i=0; i<ANIM_SIZE; i++) {
-			anim_steps[i] = malloc(2*sizeof(int));
-		}
-		int n_anim_steps;
-
-		plot_coords(o_xy, mid, n_xy, (int) points_to_plot, anim_steps, &n_anim_steps);
-
-		struct anim_data *animation = malloc(sizeof(struct anim_data));
+		// released by the tick callback destroy notify
+		struct anim_data *animation = acquire_anim_data();
 		animation->old_col = old_col;
 		animation->old_row = old_row;
 		animation->new_col = new_col;
@@ -1358,9 +1372,15 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 
 		}
 		animation->piece = piece;
-		animation->plots = anim_steps;
-		animation->n_plots = n_anim_steps;
-		animation->step_index = 1;
+		animation->start[0] = animation->prev[0] = o_xy[0];
+		animation->start[1] = animation->prev[1] = o_xy[1];
+		animation->mid[0] = mid[0];
+		animation->mid[1] = mid[1];
+		animation->end[0] = n_xy[0];
+		animation->end[1] = n_xy[1];
+		// start time is taken from the first frame
+		animation->start_time = 0;
+		animation->duration = (gint64) ((points_to_plot + 2) * ANIM_STEP_USEC);
 		animation->move_source = move_source;
 		animation->killed_by = KILLED_BY_NONE;
 
@@ -1378,9 +1398,13 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 
 		g_hash_table_insert(anims_map, animation->piece, animation);
 
-//		g_timeout_add(1000/240, animate_one_step, animation);
-//		g_timeout_add(1000/60, animate_one_step, animation);
-		g_timeout_add(8, animate_one_step, animation);
+		if (lock_threads) {
+			gdk_threads_enter();
+		}
+		gtk_widget_add_tick_callback(board, animate_tick, animation, release_anim_data);
+		if (lock_threads) {
+			gdk_threads_leave();
+		}
 		return TRUE;
 	}
 
@@ -1397,7 +1421,7 @@ gboolean auto_move(chess_piece *piece, int new_col, int new_row, int check_legal
 
 void init_dragging_background(int wi, int hi) {
 	cairo_surface_destroy (dragging_background);
-	dragging_background = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, wi, hi);
+	dragging_background = create_layer(wi, hi);
 	cairo_t *drag_dc = cairo_create(dragging_background);
 	paint_layers(drag_dc);
 	cairo_destroy (drag_dc);
@@ -1430,28 +1454,6 @@ static void update_dragging_background(chess_piece *piece, int wi, int hi) {
 	cairo_destroy(drag_dc);
 }
 
-// Refresh dragging background for a square
-static void update_dragging_background_at(int col, int row, int wi, int hi) {
-	double ww = wi / 8.0f;
-	double hh = hi / 8.0f;
-
-	double xy[2];
-	loc_to_xy(col, row, xy, wi, hi);
-
-	cairo_t *drag_dc = cairo_create(dragging_background);
-
-	// Repaint square from which piece originated without the pieces layer, thus removing the dragged piece
-	cairo_rectangle(drag_dc, xy[0] - wi / 16.0f, xy[1] - hi / 16.0f, ww, hh);
-	cairo_clip(drag_dc);
-	paint_layers(drag_dc);
-	cairo_destroy(drag_dc);
-}
-
-// Refresh dragging background for the square piece is on
-static void update_dragging_background_with_piece(chess_piece *piece, int wi, int hi) {
-	update_dragging_background_at(piece->pos.column, piece->pos.row, wi, hi);
-}
-
 static void restore_dragging_background(chess_piece *piece, int move_result, int wi, int hi) {
 
 	double ww = wi/8.0f;
@@ -1538,11 +1540,6 @@ static void clean_last_drag_step(cairo_t *cdc, double wi, double hi) {
 	cairo_restore(cdc);
 }
 
-void squares_for_move(cairo_t *dc, int move[4], int wi, int hi) {
-	square_to_rectangle(dc, move[0], move[1], wi, hi);
-	square_to_rectangle(dc, move[2], move[3], wi, hi);
-}
-
 void handle_left_mouse_up(void) {
 	double old_xy[2];
 	int new_x, new_y;
@@ -1658,256 +1655,41 @@ void handle_left_mouse_up(void) {
 		ij[0] = mouse_dragged_piece->pos.column;
 		ij[1] = mouse_dragged_piece->pos.row;
 
-		double xy[2];
-		double ww = wi/8.0f;
-		double hh = hi/8.0f;
-		loc_to_xy(ij[0], ij[1], xy, wi, hi);
-
-		cairo_t *cache_dc = cairo_create(cache_layer);
-
-		// repaint square from last dragging step
-		clean_last_drag_step(cache_dc, wi, hi);
+		// repaint area from last dragging step
+		double dragged_x, dragged_y;
+		get_dragging_prev_xy(&dragged_x, &dragged_y);
+		invalidate_rectangle(dragged_x - 1 - wi / 16.0f, dragged_y - 1 - hi / 16.0f, wi / 8.0f + 2, hi / 8.0f + 2);
 
 		// repaint destination square
-		cairo_save(cache_dc);
-		cairo_rectangle(cache_dc, floor(xy[0] - wi / 16.0f), floor(xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
-		cairo_clip(cache_dc);
-		paint_layers(cache_dc);
-		cairo_restore(cache_dc);
-
-		if (is_pre_move) {
-			cairo_save(cache_dc);
-			squares_for_move(cache_dc, prev_highlighted_pre_move, wi, hi);
-			cairo_clip(cache_dc);
-			paint_layers(cache_dc);
-			cairo_restore(cache_dc);
-			cairo_t *drag_cr = cairo_create(dragging_background);
-			squares_for_move(drag_cr, prev_highlighted_move, wi, hi);
-			cairo_clip(drag_cr);
-			paint_layers(drag_cr);
-			cairo_destroy(drag_cr);
-		}
-
-		// if was castle move, handle rook
-		int oc = -1;
-		int or = -1;
-		int nc = -1;
-		int nr = -1;
-		double rook_xy[2];
-		if (move_result > 0 && move_result & CASTLE) {
-			switch (move_result & MOVE_DETAIL_MASK) {
-				case W_CASTLE_LEFT:
-					oc = 0;
-					or = 0;
-					nc = 3;
-					nr = 0;
-					break;
-				case W_CASTLE_RIGHT:
-					oc = 7;
-					or = 0;
-					nc = 5;
-					nr = 0;
-					break;
-				case B_CASTLE_LEFT:
-					oc = 0;
-					or = 7;
-					nc = 3;
-					nr = 7;
-					break;
-				case B_CASTLE_RIGHT:
-					oc = 7;
-					or = 7;
-					nc = 5;
-					nr = 7;
-					break;
-				default:
-					// Bug if it happens
-					break;
-			}
-			update_pieces_surface_by_loc(wi, hi, oc, or, nc, nr);
-
-			// repaint rook source square
-			loc_to_xy(oc, or, rook_xy, wi, hi);
-			cairo_rectangle(cache_dc, floor(rook_xy[0]-wi/16.0f), floor(rook_xy[1]-hi/16.0f), ceil(ww), ceil(hh));
-			cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
-			cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
-			cairo_fill_preserve(cache_dc);
-			cairo_set_operator (cache_dc, CAIRO_OPERATOR_OVER);
-			cairo_set_source_surface(cache_dc, coordinates_layer, 0.0f, 0.0f);
-			cairo_fill(cache_dc);
-
-			// repaint rook destination square
-			loc_to_xy(nc, nr, rook_xy, wi, hi);
-			cairo_rectangle(cache_dc, floor(rook_xy[0]-wi/16.0f), floor(rook_xy[1]-hi/16.0f), ceil(ww), ceil(hh));
-			cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
-			cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
-			cairo_fill_preserve(cache_dc);
-			cairo_set_operator (cache_dc, CAIRO_OPERATOR_OVER);
-			cairo_set_source_surface(cache_dc, coordinates_layer, 0.0f, 0.0f);
-			cairo_fill_preserve(cache_dc);
-			cairo_set_source_surface(cache_dc, pieces_layer, 0.0f, 0.0f);
-			cairo_fill(cache_dc);
-		}
+		mark_square_dirty(ij[0], ij[1]);
 
-		double pawn_xy[2];
-		if (move_result > 0 && move_result & EN_PASSANT) {
-			loc_to_xy(ij[0], ij[1] + (mouse_dragged_piece->colour ? 1 : -1), pawn_xy, wi, hi);
-			// repaint square where eaten pawn was
-			cairo_rectangle(cache_dc, pawn_xy[0]-wi/16.0f, pawn_xy[1]-hi/16.0f, ww, hh);
-			cairo_set_source_surface(cache_dc, board_layer, 0.0f, 0.0f);
-			cairo_set_operator (cache_dc, CAIRO_OPERATOR_SOURCE);
-			cairo_fill(cache_dc);
-			kill_piece_from_surface(wi, hi, ij[0], ij[1] + (main_game->whose_turn ? -1 : 1));
-		}
+		// if was castle or en-passant move, handle rook or eaten pawn
+		update_special_move_squares(move_result, mouse_dragged_piece->colour, ij[0], ij[1], wi, hi);
 
-		chess_piece *clean_old_check = king_in_check_piece;
-		double old_king_xy[2];
-		bool king_is_checked = false;
-		double king_xy[2];
-		int old_highlights[4];
-		old_highlights[0] = -1;
 		if (move_result >= 0) {
 
 			// Clean up all highlights after a successful move
+			// (this marks the previously highlighted squares dirty)
 			init_highlight_under_surface(wi, hi);
 //			init_highlight_over_surface(wi, hi);
 
 			// Clean the ghost
 			kill_piece_from_surface(wi, hi, p_old_col, p_old_row);
-			cairo_save(cache_dc);
-			cairo_rectangle(cache_dc, floor(old_xy[0] - wi / 16.0f), floor(old_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
-			cairo_clip(cache_dc);
-			paint_layers(cache_dc);
-			cairo_restore(cache_dc);
+			mark_square_dirty(p_old_col, p_old_row);
 
 			if (highlight_last_move) {
-				cairo_save(cache_dc);
-				old_highlights[0] = prev_highlighted_move[0];
-				old_highlights[1] = prev_highlighted_move[1];
-				old_highlights[2] = prev_highlighted_move[2];
-				old_highlights[3] = prev_highlighted_move[3];
-
-				// de-highlight previous move
-				if (prev_highlighted_move[0] > -1) {
-					// Special clipping
-					square_to_rectangle(cache_dc, prev_highlighted_move[0], prev_highlighted_move[1], wi, hi);
-					square_to_rectangle(cache_dc, prev_highlighted_move[2], prev_highlighted_move[3], wi, hi);
-				}
-
-				// paint to highlight layer
 				highlight_move(p_old_col, p_old_row, ij[0], ij[1], wi, hi);
-
-				// update cache surface (used for scaling)
-				square_to_rectangle(cache_dc, p_old_col, p_old_row, wi, hi);
-				square_to_rectangle(cache_dc, ij[0], ij[1], wi, hi);
-				cairo_clip(cache_dc);
-				paint_layers(cache_dc);
-				cairo_restore(cache_dc);
-
-				// update dragging surface
-				cairo_t *drag_cr = cairo_create(dragging_background);
-				square_to_rectangle(drag_cr, p_old_col, p_old_row, wi, hi);
-				square_to_rectangle(drag_cr, ij[0], ij[1], wi, hi);
-				cairo_clip(drag_cr);
-				paint_layers(drag_cr);
-				cairo_destroy(drag_cr);
 			}
 
-			king_is_checked = is_king_checked(main_game, main_game->whose_turn);
-			if (king_is_checked) {
+			if (is_king_checked(main_game, main_game->whose_turn)) {
 				warn_check(wi, hi);
-
-				loc_to_xy(king_in_check_piece->pos.column, king_in_check_piece->pos.row, king_xy, wi, hi);
-				cairo_save(cache_dc);
-				cairo_rectangle(cache_dc, king_xy[0] - wi / 16.0f, king_xy[1] - hi / 16.0f, ww, hh);
-				cairo_clip(cache_dc);
-				paint_layers(cache_dc);
-				cairo_restore(cache_dc);
-
-				update_dragging_background_with_piece(king_in_check_piece, wi, hi);
 			} else {
 				king_in_check_piece = NULL;
 			}
-
-			if (clean_old_check != NULL) {
-				if (clean_old_check != mouse_dragged_piece) {
-					loc_to_xy(clean_old_check->pos.column, clean_old_check->pos.row, old_king_xy, wi, hi);
-					cairo_rectangle(cache_dc, old_king_xy[0] - wi / 16.0f, old_king_xy[1] - hi / 16.0f, ww, hh);
-					cairo_clip(cache_dc);
-					paint_layers(cache_dc);
-					update_dragging_background_with_piece(clean_old_check, wi, hi);
-				} else {
-					update_dragging_background_at(p_old_col, p_old_row, wi, hi);
-					clean_old_check = NULL;
-				}
-			}
-		}
-
-		// destroy buffer drawing context
-		cairo_destroy(cache_dc);
-
-		cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-
-		double dragged_x, dragged_y;
-		get_dragging_prev_xy(&dragged_x, &dragged_y);
-
-		// clip cr to repaint only needed squares
-		cairo_rectangle(cdr, dragged_x - wi / 16.0f, dragged_y - hi / 16.0f, ww, hh);
-		cairo_rectangle(cdr, floor(xy[0] - wi / 16.0f), floor(xy[1] - hi / 16.0f), ceil(ww + 1), ceil(hh + 1));
-
-		if (is_pre_move) {
-			square_to_rectangle(cdr, prev_highlighted_pre_move[0], prev_highlighted_pre_move[1], wi, hi);
-			square_to_rectangle(cdr, prev_highlighted_pre_move[2], prev_highlighted_pre_move[3], wi, hi);
-		}
-
-		// Add special clipping squares in case of castling
-		if (move_result > 0 && move_result & CASTLE) {
-			loc_to_xy(oc, or, rook_xy, wi, hi);
-			cairo_rectangle(cdr, floor(rook_xy[0] - wi / 16.0f), floor(rook_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
-			loc_to_xy(nc, nr, rook_xy, wi, hi);
-			cairo_rectangle(cdr, floor(rook_xy[0] - wi / 16.0f), floor(rook_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
-		}
-
-		// Add special clipping squares in case of en-passant
-		if (move_result > 0 && move_result & EN_PASSANT) {
-			loc_to_xy(ij[0], ij[1] + (mouse_dragged_piece->colour ? 1 : -1), pawn_xy, wi, hi);
-			cairo_rectangle(cdr, floor(pawn_xy[0] - wi / 16.0f), floor(pawn_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
-		}
-
-		// Add special clipping squares if king is checked
-		if (king_is_checked) {
-			cairo_rectangle(cdr, floor(king_xy[0] - wi / 16.0f), floor(king_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
-		}
-
-		if (clean_old_check != NULL && move_result >= 0) {
-			cairo_rectangle(cdr, floor(old_king_xy[0] - wi / 16.0f), floor(old_king_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
-		}
-
-		// Clean the ghost
-		if (move_result >= 0) {
-			cairo_rectangle(cdr, floor(old_xy[0] - wi / 16.0f), floor(old_xy[1] - hi / 16.0f), ceil(ww), ceil(hh));
-		}
-
-		// Clean last move highlight
-		if (old_highlights[0] > -1) {
-			square_to_rectangle(cdr, old_highlights[0], old_highlights[1], wi, hi);
-			square_to_rectangle(cdr, old_highlights[2], old_highlights[3], wi, hi);
 		}
 
-		// Actual clip
-		cairo_clip(cdr);
-
-		cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-		cairo_set_operator (cdr, CAIRO_OPERATOR_SOURCE);
-		cairo_paint(cdr);
-
-		// debug : uncomment the following to highlight repainted areas
-//		cairo_set_source_rgba (cdr, 0.0f, 1.0f, 0.0f, .25f);
-//		cairo_paint(cdr);
-
-		cairo_destroy(cdr);
-
-		restore_dragging_background(mouse_dragged_piece, move_result, wi, hi);
+		// Pre-move squares were marked by highlight_pre_move
+		flush_dirty_squares(wi, hi);
 
 		mouse_dragged_piece = NULL;
 	}
@@ -1950,17 +1732,7 @@ void handle_left_mouse_up(void) {
 				}
 				cairo_destroy(high_cr);
 
-				// paint to main
-				cairo_t *main_cr = gdk_cairo_create(gtk_widget_get_window(board));
-				clip_to_square(main_cr, ij[0], ij[1], wi, hi);
-				paint_layers(main_cr);
-				cairo_destroy(main_cr);
-
-				// update cache surface (used for scaling)
-				cairo_t *cache_cr = cairo_create(cache_layer);
-				clip_to_square(cache_cr, ij[0], ij[1], wi, hi);
-				paint_layers(cache_cr);
-				cairo_destroy(cache_cr);
+				flush_dirty_squares(wi, hi);
 
 			} else {
 				// 2. click and released on same square but piece WAS selected before: de-selecting
@@ -2015,28 +1787,7 @@ void cancel_pre_move(int wi, int hi, bool lock_threads) {
 			cairo_destroy(high_cr);
 		}
 
-		cairo_t *cache_dc = cairo_create(cache_layer);
-		square_to_rectangle(cache_dc, old_pre_move[0], old_pre_move[1], wi, hi);
-		square_to_rectangle(cache_dc, old_pre_move[2], old_pre_move[3], wi, hi);
-		cairo_clip(cache_dc);
-		paint_layers(cache_dc);
-		cairo_destroy(cache_dc);
-
-		cairo_t *drag_cr = cairo_create(dragging_background);
-		square_to_rectangle(drag_cr, old_pre_move[0], old_pre_move[1], wi, hi);
-		square_to_rectangle(drag_cr, old_pre_move[2], old_pre_move[3], wi, hi);
-		cairo_clip(drag_cr);
-		paint_layers(drag_cr);
-		cairo_destroy(drag_cr);
-
-		cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-		square_to_rectangle(cdr, old_pre_move[0], old_pre_move[1], wi, hi);
-		square_to_rectangle(cdr, old_pre_move[2], old_pre_move[3], wi, hi);
-		cairo_clip(cdr);
-		cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-		cairo_set_operator (cdr, CAIRO_OPERATOR_SOURCE);
-		cairo_paint(cdr);
-		cairo_destroy(cdr);
+		flush_dirty_squares(wi, hi);
 	}
 	if (lock_threads) {
 		gdk_threads_leave();
@@ -2057,9 +1808,7 @@ void handle_left_mouse_down(GtkWidget *pWidget, int wi, int hi, int x, int y) {
 			cairo_destroy(high_cr);
 		}
 
-		cairo_t *board_cr = gdk_cairo_create(gtk_widget_get_window(pWidget));
-		paint_layers_at_square(board_cr, mouse_clicked[0], mouse_clicked[1], wi, hi);
-		cairo_destroy(board_cr);
+		flush_dirty_squares(wi, hi);
 	}
 
 	chess_square* square = xy_to_square(main_game, x, y, wi, hi);
@@ -2082,25 +1831,7 @@ void handle_left_mouse_down(GtkWidget *pWidget, int wi, int hi, int x, int y) {
 				pre_move[3] = ij[1];
 				set_pre_move(pre_move);
 				highlight_pre_move(pre_move, wi, hi);
-
-				cairo_t *cache_dc = cairo_create(cache_layer);
-				squares_for_move(cache_dc, pre_move, wi, hi);
-				cairo_clip(cache_dc);
-				paint_layers(cache_dc);
-
-				cairo_t *drag_cr = cairo_create(dragging_background);
-				squares_for_move(drag_cr, pre_move, wi, hi);
-				cairo_clip(drag_cr);
-				paint_layers(drag_cr);
-				cairo_destroy(drag_cr);
-
-				cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-				squares_for_move(cdr, pre_move, wi, hi);
-				cairo_clip(cdr);
-				cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-				cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
-				cairo_paint(cdr);
-				cairo_destroy(cdr);
+				flush_dirty_squares(wi, hi);
 
 				just_made_premove = true;
 				return;
@@ -2124,14 +1855,17 @@ void handle_left_mouse_down(GtkWidget *pWidget, int wi, int hi, int x, int y) {
 
 	if (mouse_dragged_piece != NULL) {
 		piece_to_ghost(mouse_dragged_piece, wi, hi);
-		cairo_t *drag_dc = cairo_create(dragging_background);
-		paint_layers(drag_dc);
+		mark_square_dirty(mouse_dragged_piece->pos.column, mouse_dragged_piece->pos.row);
+		flush_dirty_squares(wi, hi);
 
 		double xy[2];
 		piece_to_xy(mouse_dragged_piece, xy, wi, hi);
 		set_dragging_prev_xy(xy[0], xy[1]);
 
 		set_moveit_flag(true);
+		if (drag_tick_id == 0) {
+			drag_tick_id = gtk_widget_add_tick_callback(board, drag_tick, NULL, NULL);
+		}
 
 		if (highlight_moves) {
 			highlightPotentialMoves(pWidget, mouse_dragged_piece, wi, hi, TRUE);
@@ -2168,192 +1902,59 @@ void handle_flip_board(GtkWidget *pWidget, bool lock_threads) {
 		gdk_threads_enter();
 	}
 
-	// Logical flip and repaint all layer
+	// Logical flip and repaint all layers, cache and dragging background
 	flip_board(old_wi, old_hi);
 
-	// Reconstruct cache layer
-	cairo_t *cache_cr = cairo_create(cache_layer);
-	paint_layers(cache_cr);
-	cairo_destroy(cache_cr);
-
-	// Update displayed board
-	cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(pWidget));
-	cairo_set_source_surface(cdr, cache_layer, 0, 0);
-	cairo_set_operator(cdr, CAIRO_OPERATOR_SOURCE);
-	cairo_paint(cdr);
-
-	cairo_destroy(cdr);
-
-	init_dragging_background(old_wi, old_hi);
-
 	if (lock_threads) {
 		gdk_threads_leave();
 	}
 }
 
-void *process_moves(void *ptr) {
-	double dragged_x, dragged_y;
-	while (is_running_flag()) {
-
-		if (is_moveit_flag() && is_more_events_flag()) {
-
-			gdk_threads_enter();
-
-			int wi = gtk_widget_get_allocated_width(board);
-			int hi = gtk_widget_get_allocated_height(board);
-			double ww = wi/8.0f;
-			double hh = hi/8.0f;
-
-			if (mouse_dragged_piece == NULL || !is_moveit_flag()) {
-				debug("Dragging animation interrupted\n");
-				gdk_threads_leave();
-				continue;
-			}
-
-			get_dragging_prev_xy(&dragged_x, &dragged_y);
-			if (mouse_dragged_piece->dead) {
-
-				debug("handling case when dragged piece was killed\n");
-				set_moveit_flag(false);
-
-				// repaint square from last dragging step
-				cairo_t *cache_dc = cairo_create(cache_layer);
-				clean_last_drag_step(cache_dc, wi, hi);
-				cairo_destroy(cache_dc);
-
-				cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-
-				// clip cr to repaint only needed square
-				cairo_rectangle(cdr, floor(dragged_x - wi / 16.0f), floor(dragged_y - hi / 16.0f), ceil(ww),
-				                ceil(hh));
-
-				// Actual clip
-				cairo_clip(cdr);
-
-				cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-				cairo_set_operator(cdr, CAIRO_OPERATOR_OVER);
-				cairo_paint(cdr);
-
-				mouse_dragged_piece = NULL;
-
-				gdk_threads_leave();
-				continue;
-			}
-
-			// Get coordinates from last mouse move
-			int new_x, new_y;
-			get_last_move_xy(&new_x, &new_y);
-
-			// Mark that we processed the last motion event
-			set_more_events_flag(false);
-
-			// double buffering using cache layer
-
-			// Paint dragging Background to cache layer
-			cairo_t *cache_dc = cairo_create(cache_layer);
-			cairo_set_operator(cache_dc, CAIRO_OPERATOR_SOURCE);
-			cairo_set_source_surface(cache_dc, dragging_background, 0.0f, 0.0f);
-			cairo_paint(cache_dc);
-
-			// Paint piece at new position to cache layer
-			cairo_set_source_surface(cache_dc, mouse_dragged_piece->surf, new_x - wi / 16.0f, new_y - hi / 16.0f);
-			cairo_set_operator(cache_dc, CAIRO_OPERATOR_OVER);
-			cairo_paint(cache_dc);
-
-			// destroy cache_dc
-			cairo_destroy(cache_dc);
-
-			// Efficient clip
-			cairo_t *cdr = gdk_cairo_create(gtk_widget_get_window(board));
-			cairo_rectangle(cdr, floor(dragged_x - wi / 16.0f), floor(dragged_y - hi / 16.0f), ceil(ww), ceil(hh));
-			cairo_rectangle(cdr, floor(new_x - wi / 16.0f), floor(new_y - hi / 16.0f), ceil(ww), ceil(hh));
-			cairo_clip(cdr);
-
-			// Apply cache surface to visible canvas
-			cairo_set_operator(cdr, CAIRO_OPERATOR_OVER);
-			cairo_set_source_surface(cdr, cache_layer, 0.0f, 0.0f);
-			cairo_paint(cdr);
-
-			// debug: uncomment to highlight repainted areas
-//			cairo_set_source_rgba(cdr, 1.0f, 0.0f, 0.0f, .4f);
-//			cairo_rectangle(cdr, dragged_x - wi / 16.0f, dragged_y - hi / 16.0f, ww, hh);
-//			cairo_fill(cdr);
-//			cairo_set_source_rgba(cdr, 0.0f, 1.0f, 0.0f, .4f);
-//			cairo_rectangle(cdr, new_x - wi / 16.0f, new_y - hi / 16.0f, ww, hh);
-//			cairo_fill(cdr);
-
-			cairo_destroy(cdr);
-
-			// FIXME: clean this whole dragging_prev_x shite
-			set_dragging_prev_xy(new_x, new_y);
-
-			gdk_threads_leave();
-
-		}
-//		usleep(1000000/120);
-//		usleep(1000000/60);
-		usleep(3000);
+/* Frame clock callback while a piece is being dragged.
+ * Motion events only record the pointer position, so however many arrived
+ * since the last frame, the piece is drawn once per frame at the latest one */
+static gboolean drag_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer data) {
+	if (mouse_dragged_piece == NULL || !is_moveit_flag()) {
+		drag_tick_id = 0;
+		return G_SOURCE_REMOVE;
 	}
-	return 0;
-}
 
-/* Generate an array of xy coordinates to animate a move from start->mid->end. */
-// FIXME: review this
-static void plot_coords(double start[2], double mid[2], double end[2], int points_to_plot, double **plots, int *nPlots) {
-	//int denom;
-	double denom;
-	int n, count;
-	double half_points_num = points_to_plot/2.0f;
-	double k = pow(50, ((double)1.0f)/half_points_num);
-	//printf("k %f\n", k);
-	count = 0;
+	int wi = gtk_widget_get_allocated_width(board);
+	int hi = gtk_widget_get_allocated_height(board);
+	double ww = wi / 8.0f;
+	double hh = hi / 8.0f;
 
-	/* add the start position to the plots */
-	plots[count][0] = start[0];
-	plots[count][1] = start[1];
-	count++;
+	double dragged_x, dragged_y;
+	get_dragging_prev_xy(&dragged_x, &dragged_y);
 
-	/* Step in */
-	denom = pow(k, half_points_num);
+	if (mouse_dragged_piece->dead) {
+		debug("handling case when dragged piece was killed\n");
+		set_moveit_flag(false);
+		mouse_dragged_piece = NULL;
 
-	for (n = 0; n < half_points_num; n++) {
-		plots[count][0] = start[0] + (mid[0] - start[0]) / denom;
-		plots[count][1] = start[1] + (mid[1] - start[1]) / denom;
-		count ++;
-		denom /= k;
+		// repaint square from last dragging step
+		invalidate_rectangle(dragged_x - 1 - wi / 16.0f, dragged_y - 1 - hi / 16.0f, ww + 2, hh + 2);
+		drag_tick_id = 0;
+		return G_SOURCE_REMOVE;
 	}
 
-	/* Step out */
-	denom = k;
-	for (n = 0; n < half_points_num; n++) {
-		plots[count][0] = end[0] - (end[0] - mid[0]) / denom;
-		plots[count][1] = end[1] - (end[1] - mid[1]) / denom;
-		count++;
-		denom *= k;
+	if (!is_more_events_flag()) {
+		return G_SOURCE_CONTINUE;
 	}
 
-	/* add the final position to the plots */
-	plots[count][0] = end[0];
-	plots[count][1] = end[1];
-	count++;
-
-	*nPlots = count;
-}
+	// Get coordinates from last mouse move
+	int new_x, new_y;
+	get_last_move_xy(&new_x, &new_y);
 
+	// Mark that we processed the last motion event
+	set_more_events_flag(false);
+	set_dragging_prev_xy(new_x, new_y);
 
-/* This must be called to free up the malloc'ed memory */
-static void free_anim_data(struct anim_data *anim) {
-	int i;
-	for (i = 0; i < ANIM_SIZE; i++) {
-		free(anim->plots[i]);
-	}
-	free(anim->plots);
-	free(anim);
-}
+	// Only the two damaged rectangles get recomposited (see draw_cheap_repaint)
+	invalidate_rectangle(dragged_x - wi / 16.0f, dragged_y - hi / 16.0f, ww, hh);
+	invalidate_rectangle(new_x - wi / 16.0f, new_y - hi / 16.0f, ww, hh);
 
-static void clip_to_square(cairo_t *dc, int col, int row, int wi, int hi) {
-	square_to_rectangle(dc, col, row, wi, hi);
-	cairo_clip(dc);
+	return G_SOURCE_CONTINUE;
 }
 
 static void square_to_rectangle(cairo_t *dc, int col, int row, int wi, int hi) {
@@ -2380,6 +1981,9 @@ static void highlight_square(cairo_t *dc, int col, int row, double r, double g,
 	cairo_rectangle(dc, xy[0] - half_width, xy[1] - half_height, square_width, square_height);
 	cairo_set_source_rgba(dc, r, g, b, a);
 	cairo_fill(dc);
+
+	highlighted_squares |= SQUARE_BIT(col, row);
+	mark_square_dirty(col, row);
 }
 
 // Highlight a square to mark check
@@ -2400,6 +2004,10 @@ static void highlight_check_square(cairo_t *dc, int col, int row, double r, doub
 	cairo_set_source(dc, p);
 	cairo_mask(dc, p);
 	cairo_fill(dc);
+	cairo_pattern_destroy(p);
+
+	highlighted_squares |= SQUARE_BIT(col, row);
+	mark_square_dirty(col, row);
 }
 
 static void logical_promote(int last_promote) {
@@ -2501,34 +2109,14 @@ void choose_promote(int last_promote, bool only_surfaces, bool only_logical, int
 	if (!only_logical) {
 		update_pieces_surface_by_loc(old_wi, old_hi, ncol, nrow, ncol, nrow);
 
-		/* update the dragging background layer with the new piece surface */
-		restore_dragging_background(to_promote, PIECE_TAKEN, old_wi, old_hi);
-
-		if (!GTK_IS_WIDGET(board)) {
-			// killed? tough
-			return;
-		}
-
 		// repaint that square for new piece to appear
-		double xy[2];
-		loc_to_xy(ncol, nrow, xy, old_wi, old_hi);
-		gtk_widget_queue_draw_area(board,
-		                           (int) floor(xy[0] - old_wi / 16.0),
-		                           (int) floor(xy[1] - old_hi / 16.0),
-		                           (int) ceil(old_wi / 8.0),
-		                           (int) ceil(old_hi / 8.0));
-
-		bool king_is_checked = is_king_checked(main_game, main_game->whose_turn);
-		if (king_is_checked) {
-			double king_xy[2];
+		mark_square_dirty(ncol, nrow);
+
+		if (is_king_checked(main_game, main_game->whose_turn)) {
 			warn_check(old_wi, old_hi);
-			loc_to_xy(king_in_check_piece->pos.column, king_in_check_piece->pos.row, king_xy, old_wi, old_wi);
-			gtk_widget_queue_draw_area(board,
-			                           (int) floor(king_xy[0] - old_wi / 16.0),
-			                           (int) floor(king_xy[1] - old_hi / 16.0),
-			                           (int) ceil(old_wi / 8.0),
-			                           (int) ceil(old_hi / 8.0));
 		}
+
+		flush_dirty_squares(old_wi, old_hi);
 	}
 
 }
@@ -2551,6 +2139,8 @@ void choose_promote_handler(void *GtkWidget, gpointer value) {
 }
 
 void reset_board(void) {
+	// Wipe highlights before the squares move with the flip
+	init_highlight_under_surface(old_wi, old_hi);
 	set_board_flipped(false);
 	mouse_clicked[0] = -1;
 	mouse_clicked[1] = -1;
@@ -2559,11 +2149,10 @@ void reset_board(void) {
 	prev_highlighted_move[0] = -1;
 	// Need to reassign surfaces in case of promotions during previous game
 	assign_surfaces();
-	init_highlight_under_surface(old_wi, old_hi);
 	draw_board_surface(old_wi, old_hi);
 	draw_pieces_surface(old_wi, old_hi);
-	init_dragging_background(old_wi, old_hi);
-	gtk_widget_queue_draw(GTK_WIDGET(board));
+	mark_all_squares_dirty();
+	flush_dirty_squares(old_wi, old_hi);
 }
 
 gboolean test_animate_random_step(gpointer data) {
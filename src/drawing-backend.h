@@ -11,13 +11,14 @@
 #include "cairo-board.h"
 #include "chess-backend.h"
 
-#define ANIM_SIZE 2048
-
-void *process_moves(void *ptr);
 void reset_board(void);
 void draw_full_update(cairo_t *cdr, int wi, int hi);
 void draw_scaled(cairo_t *cdr, int wi, int hi);
 void draw_cheap_repaint(cairo_t *cdr, int wi, int hi);
+void render_position(cairo_t *target, int wi, int hi);
+void render_move(cairo_t *target, chess_piece *piece, int old_col, int old_row, int move_result, int wi, int hi);
+cairo_surface_t *render_empty_board(int wi, int hi);
+void show_position(int last_move[4], int wi, int hi);
 void handle_left_mouse_up(void);
 void handle_left_mouse_down(GtkWidget *pWidget, int wi, int hi, int x, int y);
 void handle_right_button_press(GtkWidget *pWidget, int wi, int hi);
@@ -32,6 +33,9 @@ void highlight_move(int source_col, int source_row, int dest_col, int dest_row,
 void highlight_pre_move(int pre_move[4], int wi, int hi);
 void cancel_pre_move(int wi, int hi, bool lock_threads);
 void warn_check(int wi, int hi);
+void mark_square_dirty(int col, int row);
+void mark_all_squares_dirty(void);
+void flush_dirty_squares(int wi, int hi);
 
 void choose_promote(int last_promote, bool only_surfaces, bool only_logical, int ocol, int orow, int ncol, int nrow);
 void choose_promote_handler(void *GtkWidget, gpointer value);
@@ -0,0 +1,562 @@
+/*
+ * export.c
+ *
+ * Renders the board offscreen to PNG files: the current position, every
+ * ply of a game as numbered frames, or the whole game as one animated PNG.
+ * Frames are rendered one at a time into a single surface and streamed
+ * out as they are encoded, so memory use doesn't grow with the game.
+ *
+ * The animated PNG is assembled from cairo's own PNG encoder: the IDAT
+ * chunks of each frame are rewritten as fdAT chunks on the fly.
+ *
+ * Thumbnails of a whole PGN collection are drawn by worker threads
+ * straight from the sprite cache, without going through the board layers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "export.h"
+#include "drawing-backend.h"
+#include "san_scanner.h"
+#include "sprite-cache.h"
+
+enum {
+	PNG_SIGNATURE,
+	PNG_CHUNK_HEADER,
+	PNG_CHUNK_DATA,
+	PNG_CHUNK_CRC
+};
+
+typedef struct {
+	FILE *out;
+	int width;
+	int height;
+	int frames;
+	int frame;
+	uint16_t delay_ms;
+	uint32_t sequence;
+
+	// streaming state of the PNG currently coming out of cairo
+	int state;
+	unsigned char header[8];
+	int header_len;
+	uint32_t chunk_left;
+	bool copy_chunk;
+	uint32_t crc;
+	bool failed;
+} apng_writer;
+
+static uint32_t crc_table[256];
+
+static void init_crc_table(void) {
+	uint32_t c;
+	int n, k;
+	for (n = 0; n < 256; n++) {
+		c = (uint32_t) n;
+		for (k = 0; k < 8; k++) {
+			c = (c & 1) ? 0xedb88320L ^ (c >> 1) : c >> 1;
+		}
+		crc_table[n] = c;
+	}
+}
+
+static uint32_t update_crc(uint32_t crc, const unsigned char *buf, size_t len) {
+	size_t n;
+	for (n = 0; n < len; n++) {
+		crc = crc_table[(crc ^ buf[n]) & 0xff] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+static void put_u32(unsigned char *buf, uint32_t val) {
+	buf[0] = (unsigned char) (val >> 24);
+	buf[1] = (unsigned char) (val >> 16);
+	buf[2] = (unsigned char) (val >> 8);
+	buf[3] = (unsigned char) val;
+}
+
+static uint32_t get_u32(const unsigned char *buf) {
+	return ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) | ((uint32_t) buf[2] << 8) | buf[3];
+}
+
+static void apng_write(apng_writer *w, const unsigned char *data, size_t len) {
+	if (!w->failed && fwrite(data, 1, len, w->out) != len) {
+		w->failed = true;
+	}
+}
+
+static void apng_write_chunk(apng_writer *w, const char *type, const unsigned char *data, uint32_t len) {
+	unsigned char buf[8];
+	put_u32(buf, len);
+	memcpy(buf + 4, type, 4);
+	apng_write(w, buf, 8);
+	apng_write(w, data, len);
+	put_u32(buf, update_crc(update_crc(0xffffffffL, (const unsigned char *) type, 4), data, len) ^ 0xffffffffL);
+	apng_write(w, buf, 4);
+}
+
+static void apng_write_fctl(apng_writer *w) {
+	unsigned char fctl[26];
+	put_u32(fctl, w->sequence++);
+	put_u32(fctl + 4, (uint32_t) w->width);
+	put_u32(fctl + 8, (uint32_t) w->height);
+	put_u32(fctl + 12, 0);
+	put_u32(fctl + 16, 0);
+	fctl[20] = (unsigned char) (w->delay_ms >> 8);
+	fctl[21] = (unsigned char) w->delay_ms;
+	fctl[22] = 1000 >> 8;
+	fctl[23] = 1000 & 0xff;
+	fctl[24] = 0; // APNG_DISPOSE_OP_NONE
+	fctl[25] = 0; // APNG_BLEND_OP_SOURCE
+	apng_write_chunk(w, "fcTL", fctl, sizeof(fctl));
+}
+
+/* A chunk header of the current frame is complete: decide what to do with it */
+static void apng_begin_chunk(apng_writer *w) {
+	unsigned char buf[12];
+	uint32_t len = get_u32(w->header);
+	const char *type = (const char *) w->header + 4;
+
+	w->chunk_left = len;
+	w->copy_chunk = false;
+
+	if (!memcmp(type, "IHDR", 4)) {
+		if (w->frame == 0) {
+			w->copy_chunk = true;
+		}
+	} else if (!memcmp(type, "IDAT", 4)) {
+		if (w->frame == 0) {
+			w->copy_chunk = true;
+		} else {
+			// same data with a sequence number in front
+			put_u32(buf, len + 4);
+			memcpy(buf + 4, "fdAT", 4);
+			put_u32(buf + 8, w->sequence++);
+			apng_write(w, buf, 12);
+			w->crc = update_crc(0xffffffffL, buf + 4, 8);
+			return;
+		}
+	} else if (memcmp(type, "IEND", 4) && w->frame == 0) {
+		// ancillary chunks of the first frame
+		w->copy_chunk = true;
+	}
+	if (w->copy_chunk) {
+		apng_write(w, w->header, 8);
+	}
+}
+
+static void apng_end_chunk(apng_writer *w) {
+	const char *type = (const char *) w->header + 4;
+	unsigned char actl[8];
+
+	if (!memcmp(type, "IHDR", 4)) {
+		if (w->frame == 0) {
+			put_u32(actl, (uint32_t) w->frames);
+			put_u32(actl + 4, 0); // loop forever
+			apng_write_chunk(w, "acTL", actl, sizeof(actl));
+		}
+		apng_write_fctl(w);
+	}
+}
+
+static cairo_status_t apng_stream_frame(void *closure, const unsigned char *data, unsigned int length) {
+	apng_writer *w = closure;
+	bool rewriting;
+	unsigned int n;
+
+	while (length > 0) {
+		switch (w->state) {
+			case PNG_SIGNATURE:
+			case PNG_CHUNK_HEADER:
+				n = MIN(length, (unsigned int) (8 - w->header_len));
+				memcpy(w->header + w->header_len, data, n);
+				w->header_len += n;
+				if (w->header_len < 8) {
+					break;
+				}
+				w->header_len = 0;
+				if (w->state == PNG_SIGNATURE) {
+					if (w->frame == 0) {
+						apng_write(w, w->header, 8);
+					}
+					w->state = PNG_CHUNK_HEADER;
+				} else {
+					apng_begin_chunk(w);
+					w->state = w->chunk_left ? PNG_CHUNK_DATA : PNG_CHUNK_CRC;
+				}
+				break;
+			case PNG_CHUNK_DATA:
+				n = MIN(length, w->chunk_left);
+				rewriting = w->frame > 0 && !memcmp(w->header + 4, "IDAT", 4);
+				if (w->copy_chunk || rewriting) {
+					apng_write(w, data, n);
+				}
+				if (rewriting) {
+					w->crc = update_crc(w->crc, data, n);
+				}
+				w->chunk_left -= n;
+				if (w->chunk_left == 0) {
+					w->state = PNG_CHUNK_CRC;
+				}
+				break;
+			case PNG_CHUNK_CRC:
+				n = MIN(length, (unsigned int) (4 - w->header_len));
+				w->header_len += n;
+				if (w->copy_chunk) {
+					apng_write(w, data, n);
+				}
+				if (w->header_len == 4) {
+					if (w->frame > 0 && !memcmp(w->header + 4, "IDAT", 4)) {
+						unsigned char crc[4];
+						put_u32(crc, w->crc ^ 0xffffffffL);
+						apng_write(w, crc, 4);
+					}
+					apng_end_chunk(w);
+					w->header_len = 0;
+					w->state = PNG_CHUNK_HEADER;
+				}
+				break;
+		}
+		data += n;
+		length -= n;
+	}
+	return w->failed ? CAIRO_STATUS_WRITE_ERROR : CAIRO_STATUS_SUCCESS;
+}
+
+static int apng_add_frame(apng_writer *w, cairo_surface_t *surface) {
+	w->state = PNG_SIGNATURE;
+	w->header_len = 0;
+	cairo_status_t status = cairo_surface_write_to_png_stream(surface, apng_stream_frame, w);
+	w->frame++;
+	return status != CAIRO_STATUS_SUCCESS;
+}
+
+static int write_png(cairo_surface_t *surface, const char *path) {
+	if (cairo_surface_write_to_png(surface, path) != CAIRO_STATUS_SUCCESS) {
+		fprintf(stderr, "Failed to write '%s'\n", path);
+		return 1;
+	}
+	return 0;
+}
+
+static bool has_png_suffix(const char *path) {
+	size_t len = strlen(path);
+	return len > 4 && !strcasecmp(path + len - 4, ".png");
+}
+
+/* Render the current position of main_game to a PNG file */
+int export_position_png(const char *path, int size) {
+	cairo_surface_t *frame = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+	cairo_t *cr = cairo_create(frame);
+
+	render_position(cr, size, size);
+	cairo_surface_flush(frame);
+	int ret = write_png(frame, path);
+
+	cairo_destroy(cr);
+	cairo_surface_destroy(frame);
+	return ret;
+}
+
+/* Replay list from the initial position on main_game, one frame per ply
+ * plus the initial position. If path ends in .png the frames go into a
+ * single animated PNG, otherwise path is a directory that receives one
+ * numbered PNG per frame. main_game is left at the end of the game */
+int export_game(plys_list *list, const char *path, int size, int frame_delay_ms) {
+	char frame_path[PATH_MAX];
+	apng_writer writer;
+	bool animated = has_png_suffix(path);
+	int ret = 0;
+	int i;
+
+	memset(&writer, 0, sizeof(writer));
+	if (animated) {
+		writer.out = fopen(path, "wb");
+		if (writer.out == NULL) {
+			fprintf(stderr, "Error opening file '%s' for writing\n", path);
+			return 1;
+		}
+		if (crc_table[1] == 0) {
+			init_crc_table();
+		}
+		writer.width = size;
+		writer.height = size;
+		writer.frames = list->last_ply + 1;
+		writer.delay_ms = (uint16_t) CLAMP(frame_delay_ms, 0, 65535);
+	}
+
+	cairo_surface_t *frame = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+	cairo_t *cr = cairo_create(frame);
+
+	reset_main_position();
+	render_position(cr, size, size);
+
+	for (i = 0; i <= list->last_ply && !ret; i++) {
+		if (i > 0) {
+			ply *p = list->plys[i - 1];
+			chess_piece *piece = main_game->squares[p->old_col][p->old_row].piece;
+			if (piece == NULL) {
+				fprintf(stderr, "No piece to move for ply %d\n", p->ply_number);
+				ret = 1;
+				break;
+			}
+			if (p->promo_type) {
+				main_game->promo_type = colorise_type(p->promo_type, main_game->whose_turn);
+			}
+			int move_result = move_piece(piece, p->new_col, p->new_row, 0, AUTO_SOURCE_NO_ANIM, NULL, main_game, true);
+			render_move(cr, piece, p->old_col, p->old_row, move_result, size, size);
+		}
+		cairo_surface_flush(frame);
+
+		if (animated) {
+			ret = apng_add_frame(&writer, frame);
+		} else {
+			snprintf(frame_path, sizeof(frame_path), "%s/%04d.png", path, i);
+			ret = write_png(frame, frame_path);
+		}
+	}
+
+	if (animated) {
+		apng_write_chunk(&writer, "IEND", NULL, 0);
+		if (fclose(writer.out) || writer.failed) {
+			ret = 1;
+		}
+		if (ret) {
+			// its acTL counts frames that never made it in
+			fprintf(stderr, "Failed to write '%s'\n", path);
+			unlink(path);
+		}
+	}
+
+	cairo_destroy(cr);
+	cairo_surface_destroy(frame);
+	return ret;
+}
+
+/* Everything a worker needs to draw one thumbnail, copied out of main_game
+ * so that the parser can move on to the next game */
+typedef struct {
+	int game_num;
+	signed char pieces[64]; // piece type at col * 8 + row, -1 when empty
+	int last_move[4];
+} thumb_job;
+
+typedef struct {
+	thumb_job jobs[THUMB_QUEUE_SIZE];
+	int head;
+	int count;
+	bool done;
+	int failed;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+
+	// read only once the workers are started
+	const char *out_dir;
+	int size;
+	cairo_surface_t *background;
+	cairo_surface_t *sprites[12];
+} thumb_queue;
+
+static void draw_thumbnail(thumb_queue *q, thumb_job *job, cairo_surface_t *surf) {
+	double sq = q->size / 8.0;
+	double xy[2];
+	int i;
+
+	cairo_t *cr = cairo_create(surf);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cr, q->background, 0.0f, 0.0f);
+	cairo_paint(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+	if (job->last_move[0] >= 0) {
+		cairo_set_source_rgba(cr, highlight_move_r, highlight_move_g, highlight_move_b, highlight_move_a);
+		for (i = 0; i < 4; i += 2) {
+			loc_to_xy(job->last_move[i], job->last_move[i + 1], xy, q->size, q->size);
+			cairo_rectangle(cr, xy[0] - sq / 2, xy[1] - sq / 2, sq, sq);
+		}
+		cairo_fill(cr);
+	}
+
+	for (i = 0; i < 64; i++) {
+		if (job->pieces[i] < 0) {
+			continue;
+		}
+		loc_to_xy(i / 8, i % 8, xy, q->size, q->size);
+		cairo_set_source_surface(cr, q->sprites[(int) job->pieces[i]], xy[0] - sq / 2, xy[1] - sq / 2);
+		cairo_rectangle(cr, xy[0] - sq / 2, xy[1] - sq / 2, sq, sq);
+		cairo_fill(cr);
+	}
+	cairo_destroy(cr);
+	cairo_surface_flush(surf);
+}
+
+static void *thumbnail_worker(void *data) {
+	thumb_queue *q = data;
+	thumb_job job;
+	char path[PATH_MAX];
+
+	// one surface per worker, reused for every thumbnail
+	cairo_surface_t *surf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, q->size, q->size);
+
+	for (;;) {
+		pthread_mutex_lock(&q->lock);
+		while (q->count == 0 && !q->done) {
+			pthread_cond_wait(&q->not_empty, &q->lock);
+		}
+		if (q->count == 0) {
+			pthread_mutex_unlock(&q->lock);
+			break;
+		}
+		job = q->jobs[q->head];
+		q->head = (q->head + 1) % THUMB_QUEUE_SIZE;
+		q->count--;
+		pthread_cond_signal(&q->not_full);
+		pthread_mutex_unlock(&q->lock);
+
+		draw_thumbnail(q, &job, surf);
+		snprintf(path, sizeof(path), "%s/%05d.png", q->out_dir, job.game_num);
+		if (write_png(surf, path)) {
+			pthread_mutex_lock(&q->lock);
+			q->failed++;
+			pthread_mutex_unlock(&q->lock);
+		}
+	}
+
+	cairo_surface_destroy(surf);
+	return NULL;
+}
+
+static void queue_thumbnail(thumb_queue *q, int game_num, int last_move[4]) {
+	int col, row;
+
+	pthread_mutex_lock(&q->lock);
+	while (q->count == THUMB_QUEUE_SIZE) {
+		pthread_cond_wait(&q->not_full, &q->lock);
+	}
+	thumb_job *job = &q->jobs[(q->head + q->count) % THUMB_QUEUE_SIZE];
+	job->game_num = game_num;
+	for (col = 0; col < 8; col++) {
+		for (row = 0; row < 8; row++) {
+			chess_piece *piece = main_game->squares[col][row].piece;
+			job->pieces[col * 8 + row] = (signed char) (piece != NULL ? piece->type : -1);
+		}
+	}
+	memcpy(job->last_move, last_move, sizeof(job->last_move));
+	q->count++;
+	pthread_cond_signal(&q->not_empty);
+	pthread_mutex_unlock(&q->lock);
+}
+
+/* Render one thumbnail per game of pgn_path into out_dir, named after the
+ * game number. The position is the final one, or the one after at_ply
+ * plys if at_ply > 0. The PGN is scanned once, on this thread, while
+ * n_workers threads draw and encode the thumbnails from a bounded queue.
+ * All of them share the same set of sprites and the same empty board */
+int export_thumbnails(const char *pgn_path, const char *out_dir, int size, int at_ply, int n_workers) {
+	pthread_t workers[THUMB_MAX_WORKERS];
+	thumb_queue *q;
+	int last_move[4];
+	int resolved[4];
+	int i;
+	int token = 0;
+	int game_num = 0;
+	int plys = 0;
+	int blacks_ply = 0;
+	bool inside_tags = false;
+	bool in_game = false;
+	bool skip_game = false;
+
+	if (open_file(pgn_path)) {
+		return 1;
+	}
+	n_workers = CLAMP(n_workers, 1, THUMB_MAX_WORKERS);
+
+	q = calloc(1, sizeof(thumb_queue));
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->not_empty, NULL);
+	pthread_cond_init(&q->not_full, NULL);
+	q->out_dir = out_dir;
+	q->size = size;
+	q->background = render_empty_board(size, size);
+	sprite_cache_get_set(theme_dir, size / 8, size / 8, q->sprites);
+
+	for (i = 0; i < n_workers; i++) {
+		pthread_create(&workers[i], NULL, thumbnail_worker, q);
+	}
+
+	gint64 start = g_get_monotonic_time();
+	memset(last_move, -1, sizeof(last_move));
+
+	while (token != SAN_EOF_TYPE) {
+		token = san_scanner_lex();
+
+		// games are counted from their first tag, like -gamenum does, so a
+		// game without moves still gets its thumbnail and number. Moves
+		// without any tag still make a game
+		if ((token == MATCHED_TAG && !inside_tags) || (token == MATCHED_MOVE && !in_game)) {
+			if (in_game) {
+				queue_thumbnail(q, game_num, last_move);
+			}
+			in_game = true;
+			skip_game = false;
+			game_num++;
+			plys = 0;
+			blacks_ply = 0;
+			memset(last_move, -1, sizeof(last_move));
+			reset_main_position();
+		}
+		inside_tags = token == MATCHED_TAG;
+		if (token != MATCHED_MOVE) {
+			continue;
+		}
+		if (skip_game || (at_ply > 0 && plys >= at_ply)) {
+			continue;
+		}
+
+		int t = colorise_type(type, blacks_ply);
+		if (!resolve_move(main_game, t, currentMoveString, resolved)) {
+			fprintf(stderr, "Game %d: could not resolve move %c%s, stopping at ply %d\n", game_num,
+			        type_to_char(t), currentMoveString, plys);
+			skip_game = true;
+			continue;
+		}
+		move_piece(main_game->squares[resolved[0]][resolved[1]].piece, resolved[2], resolved[3], 0,
+		           AUTO_SOURCE_NO_ANIM, NULL, main_game, true);
+		memcpy(last_move, resolved, sizeof(last_move));
+		blacks_ply = !blacks_ply;
+		plys++;
+	}
+	if (in_game) {
+		queue_thumbnail(q, game_num, last_move);
+	}
+	fclose(san_scanner_in);
+
+	pthread_mutex_lock(&q->lock);
+	q->done = true;
+	pthread_cond_broadcast(&q->not_empty);
+	pthread_mutex_unlock(&q->lock);
+	for (i = 0; i < n_workers; i++) {
+		pthread_join(workers[i], NULL);
+	}
+
+	gint64 elapsed = g_get_monotonic_time() - start;
+	printf("%d thumbnails in %.2fs with %d workers (%d failed)\n", game_num, elapsed / 1000000.0, n_workers, q->failed);
+
+	int ret = q->failed != 0;
+	for (i = 0; i < 12; i++) {
+		cairo_surface_destroy(q->sprites[i]);
+	}
+	cairo_surface_destroy(q->background);
+	pthread_mutex_destroy(&q->lock);
+	pthread_cond_destroy(&q->not_empty);
+	pthread_cond_destroy(&q->not_full);
+	free(q);
+	return ret;
+}
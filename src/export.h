@@ -0,0 +1,20 @@
+#ifndef __CAIRO_BOARD_EXPORT_H__
+#define __CAIRO_BOARD_EXPORT_H__
+
+#include "cairo-board.h"
+
+// Board size in pixels used when none is given
+#define EXPORT_DEFAULT_SIZE 480
+// Time each frame stays up in an animated export
+#define EXPORT_FRAME_DELAY_MS 800
+// Board size in pixels of a thumbnail
+#define THUMB_DEFAULT_SIZE 160
+// Parsed games waiting for a thumbnail worker
+#define THUMB_QUEUE_SIZE 64
+#define THUMB_MAX_WORKERS 32
+
+int export_position_png(const char *path, int size);
+int export_game(plys_list *list, const char *path, int size, int frame_delay_ms);
+int export_thumbnails(const char *pgn_path, const char *out_dir, int size, int at_ply, int n_workers);
+
+#endif
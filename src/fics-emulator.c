@@ -0,0 +1,520 @@
+/*
+ * fics-emulator.c
+ *
+ * Local stand-in for a FICS server, to load test the client without a
+ * network. It answers the timeseal handshake, walks through the login
+ * prompts and then streams style 12 boards for a number of observed games
+ * together with channel tells, at configurable rates. Move lists are sent
+ * when the client asks for them. Timeseal pings are sent regularly and the
+ * time the client takes to answer them is reported when it disconnects.
+ *
+ * Every game plays the same knight shuffle, which keeps the positions legal
+ * forever without any move generation.
+ *
+ * Usage: fics-emulator [-port N] [-games N] [-move-rate R] [-channels N]
+ *                      [-tell-rate R] [-ping-ms MS] [-duration S] [-once]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_GAMES 1000
+#define FIRST_GAME_NUM 100
+#define IN_BUFF_SIZE 4096
+#define GUEST_HANDLE "GuestEMUL"
+
+#define PORT_ARG      1
+#define GAMES_ARG     2
+#define MOVE_RATE_ARG 3
+#define CHANNELS_ARG  4
+#define TELL_RATE_ARG 5
+#define PING_MS_ARG   6
+#define DURATION_ARG  7
+
+// Same key as codec() in netstuff.c
+static const char *key = "Timestamp (FICS) v1.0 - programmed by Henrik Gram.";
+
+/* Eight plys bringing the knights out and back home */
+static const struct {
+	int from[2];
+	int to[2];
+	const char *san;
+} shuffle[] = {
+	{ {6, 0}, {5, 2}, "Nf3" },
+	{ {6, 7}, {5, 5}, "Nf6" },
+	{ {1, 0}, {2, 2}, "Nc3" },
+	{ {1, 7}, {2, 5}, "Nc6" },
+	{ {2, 2}, {1, 0}, "Nb1" },
+	{ {2, 5}, {1, 7}, "Nb8" },
+	{ {5, 2}, {6, 0}, "Ng1" },
+	{ {5, 5}, {6, 7}, "Ng8" },
+};
+#define SHUFFLE_PLYS (sizeof(shuffle) / sizeof(shuffle[0]))
+
+struct game {
+	int num;
+	char white[16];
+	char black[16];
+	int plys;
+	// remaining time in seconds
+	int white_time;
+	int black_time;
+	char board[8][9]; // board[0] is the 8th rank, as in style 12
+};
+
+static struct game games[MAX_GAMES];
+
+/* Options */
+static unsigned short port = 5000;
+static int games_count = 50;
+static double move_rate = 1.0; // plys per second in each game
+static int channels_count = 5;
+static double tell_rate = 20.0; // tells per second over all channels
+static int ping_ms = 1000;
+static int duration = 0; // seconds, 0 for no limit
+static int once = 0;
+
+/* Per session */
+static int client_fd = -1;
+static unsigned long boards_sent, tells_sent, bytes_sent;
+static unsigned long pings_sent, acks_received, acks_timed;
+static double ack_total_ms, ack_max_ms;
+static struct timeval ping_sent_at;
+static bool ping_pending;
+
+static double elapsed_ms(struct timeval *since) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - since->tv_sec) * 1000.0 + (now.tv_usec - since->tv_usec) / 1000.0;
+}
+
+static void advance(struct timeval *tv, double ms) {
+	long usec = tv->tv_usec + (long) (ms * 1000);
+	tv->tv_sec += usec / 1000000;
+	tv->tv_usec = usec % 1000000;
+}
+
+static int send_text(const char *format, ...) {
+	char buff[8192];
+	va_list args;
+
+	va_start(args, format);
+	int len = vsnprintf(buff, sizeof(buff), format, args);
+	va_end(args);
+	if (len >= (int) sizeof(buff)) {
+		len = sizeof(buff) - 1;
+	}
+
+	int sent = 0;
+	while (sent < len) {
+		ssize_t n = write(client_fd, buff + sent, len - sent);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		sent += n;
+	}
+	bytes_sent += len;
+	return 0;
+}
+
+/* Undo codec() from netstuff.c in place, returns the length of the text
+ * in front of the timestamp */
+static size_t decode(char *s, size_t l) {
+	size_t n;
+
+	for (n = 0; n < l; n++) {
+		s[n] = (char) ((((unsigned char) s[n] + 32) ^ key[n % 50]) & 0x7f);
+	}
+#define SC(A,B) s[B]^=s[A]^=s[B],s[A]^=s[B]
+	for (n = 0; n + 11 < l; n += 12) {
+		SC(n,n+11), SC(n+2,n+9), SC(n+4,n+7);
+	}
+	char *stamp = memchr(s, '\x18', l);
+	return stamp ? (size_t) (stamp - s) : l;
+}
+
+static void reset_game(struct game *g, int index) {
+	static const char *start[8] = {
+		"rnbqkbnr", "pppppppp", "--------", "--------",
+		"--------", "--------", "PPPPPPPP", "RNBQKBNR"
+	};
+	int i;
+
+	g->num = FIRST_GAME_NUM + index;
+	// FICS handles are letters only
+	snprintf(g->white, sizeof(g->white), "White%c%c", 'a' + index / 26 % 26, 'a' + index % 26);
+	snprintf(g->black, sizeof(g->black), "Black%c%c", 'a' + index / 26 % 26, 'a' + index % 26);
+	g->plys = 0;
+	g->white_time = g->black_time = 300;
+	for (i = 0; i < 8; i++) {
+		memcpy(g->board[i], start[i], 9);
+	}
+}
+
+/* Like FICS, everything the client did not ask for starts on a new line,
+ * as the client only recognizes boards and tells at the start of one */
+static int send_board(struct game *g) {
+	char verbose[32] = "none";
+	char san[8] = "none";
+	bool black_to_play = g->plys % 2;
+
+	if (g->plys) {
+		int k = (g->plys - 1) % SHUFFLE_PLYS;
+		snprintf(verbose, sizeof(verbose), "N/%c%d-%c%d", 'a' + shuffle[k].from[0], 1 + shuffle[k].from[1],
+		         'a' + shuffle[k].to[0], 1 + shuffle[k].to[1]);
+		snprintf(san, sizeof(san), "%s", shuffle[k].san);
+	}
+	boards_sent++;
+	return send_text("\n\r<12> %s %s %s %s %s %s %s %s %c -1 1 1 1 1 %d %d %s %s 0 5 0 39 39 %d %d %d %s (0:01) %s 0 1 0\n\r",
+	                 g->board[0], g->board[1], g->board[2], g->board[3],
+	                 g->board[4], g->board[5], g->board[6], g->board[7],
+	                 black_to_play ? 'B' : 'W', g->plys, g->num, g->white, g->black,
+	                 g->white_time, g->black_time, 1 + g->plys / 2, verbose, san);
+}
+
+static int play_ply(struct game *g) {
+	int k = g->plys % SHUFFLE_PLYS;
+	char *from = &g->board[7 - shuffle[k].from[1]][shuffle[k].from[0]];
+	char *to = &g->board[7 - shuffle[k].to[1]][shuffle[k].to[0]];
+
+	*to = *from;
+	*from = '-';
+	if (g->plys % 2) {
+		g->black_time = g->black_time > 1 ? g->black_time - 1 : 300;
+	} else {
+		g->white_time = g->white_time > 1 ? g->white_time - 1 : 300;
+	}
+	g->plys++;
+	if (send_board(g)) {
+		return -1;
+	}
+	return send_text("fics%% ");
+}
+
+static int send_move_list(struct game *g) {
+	int i;
+
+	if (send_text("\n\rMovelist for game %d:\n\r\n\r%s (1500) vs. %s (1500) --- Sun Oct 19 12:00:00 2026\n\r"
+	              "Rated blitz match, initial time: 5 minutes, increment: 0 seconds.\n\r\n\r"
+	              "Move  %-16s   %-16s\n\r----  ----------------   ----------------\n\r",
+	              g->num, g->white, g->black, g->white, g->black)) {
+		return -1;
+	}
+	for (i = 0; i < g->plys; i += 2) {
+		const char *w = shuffle[i % SHUFFLE_PLYS].san;
+		if (i + 1 < g->plys) {
+			const char *b = shuffle[(i + 1) % SHUFFLE_PLYS].san;
+			if (send_text("%3d.  %-7s (0:01)     %-7s (0:01)\n\r", 1 + i / 2, w, b)) {
+				return -1;
+			}
+		} else if (send_text("%3d.  %-7s (0:01)\n\r", 1 + i / 2, w)) {
+			return -1;
+		}
+	}
+	return send_text("      {Still in progress} *\n\r\n\rfics%% ");
+}
+
+static int observe_all(void) {
+	int i;
+	for (i = 0; i < games_count; i++) {
+		struct game *g = &games[i];
+		if (send_text("\n\rYou are now observing game %d.\n\rGame %d: %s (1500) %s (1500) rated blitz 5 0\n\r\n\r",
+		              g->num, g->num, g->white, g->black) || send_board(g)) {
+			return -1;
+		}
+	}
+	return send_text("fics%% ");
+}
+
+static int send_tell(void) {
+	static const char *words[] = { "hi", "anyone", "up", "for", "a", "game", "nice", "move", "thanks", "gg" };
+	int n = tells_sent;
+	tells_sent++;
+	return send_text("\n\rTalker%c(%d): %s %s %s %lu\n\rfics%% ", 'a' + n % 26, 1 + n % channels_count,
+	                 words[n % 10], words[(n / 10) % 10], words[(n / 100) % 10], tells_sent);
+}
+
+enum session_state { WANT_HELLO, WANT_LOGIN, WANT_GUEST_RETURN, WANT_PASSWORD, LOGGED_IN };
+
+/* React to one line from the client. Returns -1 to drop the connection */
+static int handle_line(char *line, enum session_state *state) {
+	char handle[32];
+
+	// timeseal ping answer
+	if (line[0] == '\x02') {
+		if (ping_pending) {
+			double ms = elapsed_ms(&ping_sent_at);
+			ack_total_ms += ms;
+			if (ms > ack_max_ms) {
+				ack_max_ms = ms;
+			}
+			ping_pending = false;
+			acks_timed++;
+		}
+		acks_received++;
+		return 0;
+	}
+
+	switch (*state) {
+		case WANT_HELLO:
+			if (strncmp(line, "TIMESTAMP|", 10)) {
+				fprintf(stderr, "No timeseal hello, got '%s'\n", line);
+			}
+			*state = WANT_LOGIN;
+			return send_text("Welcome to the FICS emulator.\n\r\n\rlogin: ");
+		case WANT_LOGIN:
+			if (!strcmp(line, "guest") || !*line) {
+				*state = WANT_GUEST_RETURN;
+				return send_text("\n\rLogging you in as \"" GUEST_HANDLE "\"; you may use this name to play unrated games.\n\r"
+				                 "Press return to enter the server as \"" GUEST_HANDLE "\":\n\r");
+			}
+			*state = WANT_PASSWORD;
+			return send_text("\n\r\"%s\" is a registered name.\n\rpassword: ", line);
+		case WANT_GUEST_RETURN:
+		case WANT_PASSWORD:
+			snprintf(handle, sizeof(handle), "%s", *state == WANT_PASSWORD ? "EmulatedUser" : GUEST_HANDLE);
+			*state = LOGGED_IN;
+			if (send_text("\n\r**** Starting FICS session as %s%s ****\n\r\n\rfics%% ", handle,
+			              !strcmp(handle, GUEST_HANDLE) ? "(U)" : "")) {
+				return -1;
+			}
+			return observe_all();
+		case LOGGED_IN:
+			if (!strncmp(line, "moves ", 6)) {
+				int num = atoi(line + 6) - FIRST_GAME_NUM;
+				if (num >= 0 && num < games_count) {
+					return send_move_list(&games[num]);
+				}
+			}
+			if (!strcmp(line, "=chan")) {
+				int i;
+				if (send_text("\n\r-- channel list: %d channels --\n\r", channels_count)) {
+					return -1;
+				}
+				for (i = 1; i <= channels_count; i++) {
+					if (send_text("%-5d", i)) {
+						return -1;
+					}
+				}
+				return send_text("\n\rfics%% ");
+			}
+			return send_text("fics%% ");
+	}
+	return 0;
+}
+
+/* Split what the client sent in lines, decoding timeseal ones */
+static int handle_input(char *buff, size_t *len, enum session_state *state) {
+	size_t start = 0;
+	char *nl;
+
+	while ((nl = memchr(buff + start, '\n', *len - start)) != NULL) {
+		char *line = buff + start;
+		size_t l = nl - line;
+		start += l + 1;
+		if (l > 0 && (unsigned char) line[l - 1] == 0x80) {
+			l = decode(line, l - 1);
+		} else if (l > 0 && line[l - 1] == '\r') {
+			l--;
+		}
+		line[l] = '\0';
+		if (handle_line(line, state)) {
+			return -1;
+		}
+	}
+	memmove(buff, buff + start, *len - start);
+	*len -= start;
+	return 0;
+}
+
+static void serve_client(void) {
+	enum session_state state = WANT_HELLO;
+	char in[IN_BUFF_SIZE];
+	size_t in_len = 0;
+	struct timeval start, next_ply, next_tell, next_ping;
+	double ply_interval = games_count > 0 && move_rate > 0 ? 1000.0 / (move_rate * games_count) : 0;
+	double tell_interval = channels_count > 0 && tell_rate > 0 ? 1000.0 / tell_rate : 0;
+	int next_game = 0;
+	int i;
+
+	for (i = 0; i < games_count; i++) {
+		reset_game(&games[i], i);
+	}
+	boards_sent = tells_sent = bytes_sent = pings_sent = acks_received = acks_timed = 0;
+	ack_total_ms = ack_max_ms = 0;
+	ping_pending = false;
+
+	gettimeofday(&start, NULL);
+	next_ply = next_tell = next_ping = start;
+
+	for (;;) {
+		struct pollfd pfd = { client_fd, POLLIN, 0 };
+		int timeout = state == LOGGED_IN ? 1 : -1;
+
+		if (duration && elapsed_ms(&start) > duration * 1000.0) {
+			break;
+		}
+
+		int n = poll(&pfd, 1, timeout);
+		if (n < 0 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+		if (n > 0) {
+			ssize_t r = read(client_fd, in + in_len, sizeof(in) - in_len);
+			if (r <= 0) {
+				break;
+			}
+			in_len += r;
+			if (handle_input(in, &in_len, &state)) {
+				break;
+			}
+			if (in_len == sizeof(in)) {
+				fprintf(stderr, "Line too long, dropping the client\n");
+				break;
+			}
+		}
+		if (state != LOGGED_IN) {
+			continue;
+		}
+
+		// catch up with whatever is due, one ply per game in turn
+		bool failed = false;
+		while (ply_interval && elapsed_ms(&next_ply) >= 0 && !failed) {
+			failed = play_ply(&games[next_game]) < 0;
+			next_game = (next_game + 1) % games_count;
+			advance(&next_ply, ply_interval);
+		}
+		while (tell_interval && elapsed_ms(&next_tell) >= 0 && !failed) {
+			failed = send_tell() < 0;
+			advance(&next_tell, tell_interval);
+		}
+		if (ping_ms && elapsed_ms(&next_ping) >= 0 && !failed) {
+			// the client answers each ping, only time one at a time
+			if (!ping_pending) {
+				gettimeofday(&ping_sent_at, NULL);
+				ping_pending = true;
+			}
+			pings_sent++;
+			failed = send_text("\n\r[G]\n\r") < 0;
+			advance(&next_ping, ping_ms);
+		}
+		if (failed) {
+			break;
+		}
+	}
+
+	double secs = elapsed_ms(&start) / 1000.0;
+	fprintf(stdout, "Session lasted %.1fs: %lu boards (%.0f/s), %lu tells (%.0f/s), %lu bytes\n",
+	        secs, boards_sent, boards_sent / secs, tells_sent, tells_sent / secs, bytes_sent);
+	fprintf(stdout, "Pings: %lu sent, %lu answered, answer time avg %.2fms max %.2fms\n",
+	        pings_sent, acks_received, acks_timed ? ack_total_ms / acks_timed : 0, ack_max_ms);
+}
+
+int main(int argc, char **argv) {
+	static struct option long_options[] = {
+			{"port",       required_argument, 0,     PORT_ARG},
+			{"games",      required_argument, 0,     GAMES_ARG},
+			{"move-rate",  required_argument, 0,     MOVE_RATE_ARG},
+			{"channels",   required_argument, 0,     CHANNELS_ARG},
+			{"tell-rate",  required_argument, 0,     TELL_RATE_ARG},
+			{"ping-ms",    required_argument, 0,     PING_MS_ARG},
+			{"duration",   required_argument, 0,     DURATION_ARG},
+			{"once",       no_argument,       &once, 1},
+			{0,            0,                 0,     0}
+	};
+	int c;
+
+	while ((c = getopt_long_only(argc, argv, "", long_options, NULL)) != -1) {
+		switch (c) {
+			case PORT_ARG:
+				port = (unsigned short) atoi(optarg);
+				break;
+			case GAMES_ARG:
+				games_count = atoi(optarg);
+				break;
+			case MOVE_RATE_ARG:
+				move_rate = atof(optarg);
+				break;
+			case CHANNELS_ARG:
+				channels_count = atoi(optarg);
+				break;
+			case TELL_RATE_ARG:
+				tell_rate = atof(optarg);
+				break;
+			case PING_MS_ARG:
+				ping_ms = atoi(optarg);
+				break;
+			case DURATION_ARG:
+				duration = atoi(optarg);
+				break;
+			case 0:
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-port N] [-games N] [-move-rate R] [-channels N] [-tell-rate R] "
+				        "[-ping-ms MS] [-duration S] [-once]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (games_count < 0 || games_count > MAX_GAMES) {
+		fprintf(stderr, "Between 0 and %d games please\n", MAX_GAMES);
+		return 1;
+	}
+
+	// a client going away shows up as a failed write
+	signal(SIGPIPE, SIG_IGN);
+
+	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		perror("socket");
+		return 1;
+	}
+	int yes = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	struct sockaddr_in sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listen_fd, (struct sockaddr *) &sa, sizeof(sa)) || listen(listen_fd, 1)) {
+		perror("bind");
+		return 1;
+	}
+	fprintf(stdout, "FICS emulator listening on 127.0.0.1:%u, %d games at %.2f plys/s, %d channels at %.2f tells/s\n",
+	        port, games_count, move_rate, channels_count, tell_rate);
+	fflush(stdout);
+
+	// one client at a time
+	do {
+		client_fd = accept(listen_fd, NULL, NULL);
+		if (client_fd < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("accept");
+			return 1;
+		}
+		serve_client();
+		close(client_fd);
+		fflush(stdout);
+	} while (!once);
+
+	close(listen_fd);
+	return 0;
+}
@@ -1,3 +1,5 @@
+#include <ctype.h>
+
 #include "ics-adapter.h"
 #include "cairo-board.h"
 #include "ics_scanner.h"
@@ -8,14 +10,14 @@
 #include "chess-backend.h"
 #include "drawing-backend.h"
 #include "netstuff.h"
+#include "line-queue.h"
+
+// Console output is written out at least this often during bursts
+#define ICS_CONSOLE_FLUSH_SIZE 16384
 
-/* How much data we read from ICS at once
- * Try smaller values to test the stitching mechanism */
-// #define ICS_BUFF_SIZE 32
-#define ICS_BUFF_SIZE 1024
+// Games followed at once over one connection
+#define MAX_ICS_GAMES 64
 
-static int finished_parsing_moves = 0;
-static int requested_times = 0;
 static int init_time;
 static int increment;
 static char current_players[2][128];
@@ -23,16 +25,44 @@ static char current_ratings[2][128];
 static int my_channels_number;
 static char last_user[32] = {[0 ... 31] = 0};
 static int last_channel_number;
-static char *last_message;
+static char *last_message = NULL;
+static size_t last_message_alloc = 0;
 static char my_handle[128];
-static int requested_moves = 0;
 static int requested_start = 0;
-static int got_header = 0;
-static int parsed_plys = 0;
+
+/* A game we play or observe. The displayed one is on the board and lives in
+ * main_game, main_list and main_clock, the others get their own position and
+ * plys, kept up to date off screen from their style 12 boards */
+typedef struct {
+	long game_num;
+	bool displayed;
+	chess_game *game; // NULL when displayed
+	plys_list *list;  // NULL when displayed
+	int init_time;
+	int increment;
+	int white_time;
+	int black_time;
+	int requested_times;
+	int requested_moves;
+	int finished_parsing_moves;
+	int got_header;
+	int parsed_plys;
+} ics_game;
+
+static ics_game *ics_games[MAX_ICS_GAMES];
+static int ics_games_count = 0;
+// The game whose move list we are receiving
+static ics_game *move_list_game = NULL;
 
 static pthread_t ics_reader_thread;
 static pthread_t ics_buff_parser_thread;
 
+/* What we echo to the console, appended to with a cursor and written out
+ * once the parser has caught up with the ICS */
+static char *post_buff = NULL;
+static size_t post_len = 0;
+static size_t post_alloc = 0;
+
 char my_login[128];
 char my_password[128];
 char following_player[32];
@@ -41,7 +71,10 @@ bool ics_logged_in = false;
 void * icsPr;
 int ics_socket;
 int ics_fd;
-int ics_data_pipe[2];
+// Whole lines from the ICS reader thread to the parser thread
+static line_queue *ics_lines;
+// Fed from a recording, there is nobody to log in to
+static bool ics_replaying = false;
 
 bool my_channels_requested = false;
 bool got_my_channels_header = false;
@@ -100,11 +133,67 @@ bool invalid_password = false;
 -nr---k- r---qpp- --p----p p--pN--- -p-PN--- ----P--- PPQ--PPP R-R---K- B -1 0 0 0 0 0 307 pgayet radmanilko 0 3 0 32 29 140 128 20 N/c5-e4 (0:03) Nxe4 0 1 477
 */
 
-#define STYLE_12_PATTERN "%71c %c %d %d %d %d %d %d %d %s %s %d %d %d %d %d %d %d %d %s %s %s %d %d"
-// NB: 71 comes from 64 characters + 7 spaces
-
-int parse_board_tries = 0;
-char first_board_chunk[256]; // board is about 150 chars on average so 256 is safe
+// Fields after '<12> ', up to the clock ticking flag
+#define STYLE12_FIELDS 31
+// Everything up to the flip field has to be there
+#define STYLE12_REQUIRED_FIELDS 30
+
+enum style12_field {
+	S12_RANKS = 0, // eight of them
+	S12_TO_PLAY = 8,
+	S12_DOUBLE_PUSH,
+	S12_CASTLE_WS,
+	S12_CASTLE_WL,
+	S12_CASTLE_BS,
+	S12_CASTLE_BL,
+	S12_FIFTY_MOVE_COUNT,
+	S12_GAMENUM,
+	S12_W_NAME,
+	S12_B_NAME,
+	S12_RELATION,
+	S12_BASETIME,
+	S12_INCREMENT,
+	S12_WHITE_STREN,
+	S12_BLACK_STREN,
+	S12_WHITE_TIME,
+	S12_BLACK_TIME,
+	S12_MOVE_NUM,
+	S12_VERBOSE_MOVE,
+	S12_ELAPSED_TIME,
+	S12_SAN_MOVE,
+	S12_FLIP,
+	S12_TICKING
+};
+
+static const char *style12_field_names[STYLE12_FIELDS] = {
+	"8th rank", "7th rank", "6th rank", "5th rank", "4th rank", "3rd rank", "2nd rank", "1st rank",
+	"side to move", "double pawn push", "white short castle", "white long castle",
+	"black short castle", "black long castle", "fifty move count", "game number",
+	"white name", "black name", "relation", "initial time", "increment",
+	"white strength", "black strength", "white time", "black time", "move number",
+	"verbose move", "elapsed time", "pretty move", "flip", "clock ticking"
+};
+
+/* One style 12 line, the strings point into the line itself */
+typedef struct {
+	char *ranks[8]; // White's 8th rank first
+	char to_play;
+	int double_push;
+	int castle_ws, castle_wl, castle_bs, castle_bl;
+	int fifty_move_count;
+	int gamenum;
+	char *w_name, *b_name;
+	int relation;
+	int basetime, increment;
+	int white_stren, black_stren;
+	int white_time, black_time;
+	int move_num;
+	char *verbose_move;
+	char *elapsed_time;
+	char *san_move;
+	int ics_flip;
+	int ticking;
+} style12;
 
 static char last_board_chars[72];
 
@@ -134,140 +223,434 @@ bool check_board12_game_consistency() {
 	return true;
 }
 
-int parse_board12(char *string_chunk) {
-	int gamenum, relation, basetime, increment, ics_flip = 0;
-	int n, moveNum, white_stren, black_stren, white_time, black_time;
-	int double_push, castle_ws, castle_wl, castle_bs, castle_bl, fifty_move_count;
-	char to_play;
-	char str[MOVE_BUFF_SIZE], san_move[MOVE_BUFF_SIZE], elapsed_time[MOVE_BUFF_SIZE];
-	char b_name[121], w_name[121];
-	int ticking = 2;
+static bool style12_int(const char *field, int *value) {
+	char *end;
+	long l = strtol(field, &end, 10);
+	if (end == field || *end) {
+		return false;
+	}
+	*value = (int) l;
+	return true;
+}
 
-	char *board12_string;
+static bool style12_rank(const char *field) {
+	int i;
+	for (i = 0; i < 8; i++) {
+		if (!field[i] || !strchr("-pnbrqkPNBRQK", field[i])) {
+			return false;
+		}
+	}
+	return !field[8];
+}
 
-	memset(last_board_chars, 0, sizeof(last_board_chars));
-	if (parse_board_tries) { // second chunk came in
-		board12_string = first_board_chunk;
-		strcat(board12_string, string_chunk);
+/* Split a style 12 line on spaces in place, without allocating.
+ * Returns -1 on success or the index of the first missing or malformed field */
+static int tokenize_style12(char *line, style12 *b) {
+	char *fields[STYLE12_FIELDS];
+	int count = 0;
+	int i;
+	char *p = line;
+
+	while (count < STYLE12_FIELDS) {
+		while (*p == ' ') {
+			p++;
+		}
+		if (!*p || *p == '\n') {
+			break;
+		}
+		fields[count++] = p;
+		while (*p && *p != ' ' && *p != '\n') {
+			p++;
+		}
+		if (*p) {
+			*p++ = '\0';
+		}
 	}
-	else {
-		board12_string = string_chunk; // null terminated
-	}
-	debug("Board 12 string: '%s'\n", board12_string);
-
-	n = sscanf(board12_string, STYLE_12_PATTERN,
-	           last_board_chars, &to_play, &double_push,
-	           &castle_ws, &castle_wl, &castle_bs,
-	           &castle_bl, &fifty_move_count, &gamenum,
-	           w_name, b_name, &relation,
-	           &basetime, &increment, &white_stren,
-	           &black_stren, &white_time, &black_time,
-	           &moveNum, str, elapsed_time,
-	           san_move, &ics_flip, &ticking);
-
-	// We need fields up until the Pretty Move (if the flip flop status bit and the trailing characters were chopped, tough)
-	if (n < 23) {
-		if (!parse_board_tries) {
-			parse_board_tries++;
-			memcpy(first_board_chunk, board12_string, strlen(board12_string));
-			first_board_chunk[strlen(board12_string)] = 0; // NULL terminate
-			return 1;
-		} else {
-			fprintf(stderr, "FAILED to parse Board 12 String:\n\"%s\"\n", board12_string);
-			parse_board_tries = 0;
-			return -1;
+
+	for (i = 0; i < 8; i++) {
+		if (i >= count || !style12_rank(fields[i])) {
+			return S12_RANKS + i;
 		}
-	} else {
-		debug("scanned %d fields\n", n);
-		parse_board_tries = 0;
-		debug("Successfully parsed Board 12:\n");
-		debug("\tBlack's name: %s\n", b_name);
-		debug("\tWhite's name: %s\n", w_name);
-		debug("\tIt is %s's move\n", (to_play == 'B' ? "Black" : "White"));
-		debug("\tWhite's time: %ds\n", white_time);
-		debug("\tBlack's time: %ds\n", black_time);
-		debug("\tMy relation: %d\n", relation);
-		debug("\tBoard chars: '%s'\n", last_board_chars);
-		debug("\tSAN move: '%s'\n\n", san_move);
-
-		// Did we ask for times?
-		if (requested_times) {
-			requested_times = 0;
-			update_clocks(main_clock, white_time, black_time, true);
-			if (!clock_started && moveNum >= 2) {
-				clock_started = 1;
-				start_one_clock(main_clock, (to_play == 'W')?0:1);
-				debug("start clock\n");
-			}
-			return 0;
+		b->ranks[i] = fields[i];
+	}
+	if (count <= S12_TO_PLAY || (strcmp(fields[S12_TO_PLAY], "W") && strcmp(fields[S12_TO_PLAY], "B"))) {
+		return S12_TO_PLAY;
+	}
+	b->to_play = fields[S12_TO_PLAY][0];
+
+	int *ints_before_names[] = { &b->double_push, &b->castle_ws, &b->castle_wl, &b->castle_bs, &b->castle_bl,
+	                             &b->fifty_move_count, &b->gamenum };
+	for (i = 0; i < 7; i++) {
+		if (count <= S12_DOUBLE_PUSH + i || !style12_int(fields[S12_DOUBLE_PUSH + i], ints_before_names[i])) {
+			return S12_DOUBLE_PUSH + i;
 		}
+	}
 
-		// game and clocks started: update the clocks
-		if (game_started && clock_started) {
-			update_clocks(main_clock, white_time, black_time, true);
+	if (count <= S12_B_NAME) {
+		return count;
+	}
+	b->w_name = fields[S12_W_NAME];
+	b->b_name = fields[S12_B_NAME];
+
+	int *ints_after_names[] = { &b->relation, &b->basetime, &b->increment, &b->white_stren, &b->black_stren,
+	                            &b->white_time, &b->black_time, &b->move_num };
+	for (i = 0; i < 8; i++) {
+		if (count <= S12_RELATION + i || !style12_int(fields[S12_RELATION + i], ints_after_names[i])) {
+			return S12_RELATION + i;
 		}
+	}
 
-		// game started and not observing: set last move and swap clocks if needed
-		if (game_started && relation) {
-			set_last_move(san_move);
-			if (clock_started) {
-				start_one_stop_other_clock(main_clock, (to_play == 'W') ? 0 : 1, true);
+	for (i = S12_VERBOSE_MOVE; i <= S12_SAN_MOVE; i++) {
+		if (count <= i || strlen(fields[i]) >= MOVE_BUFF_SIZE) {
+			return i;
+		}
+	}
+	b->verbose_move = fields[S12_VERBOSE_MOVE];
+	b->elapsed_time = fields[S12_ELAPSED_TIME];
+	b->san_move = fields[S12_SAN_MOVE];
+
+	if (count <= S12_FLIP || !style12_int(fields[S12_FLIP], &b->ics_flip)) {
+		return S12_FLIP;
+	}
+	// not sent by every server
+	b->ticking = 2;
+	if (count > S12_TICKING && !style12_int(fields[S12_TICKING], &b->ticking)) {
+		return S12_TICKING;
+	}
+	return -1;
+}
+
+static ics_game *find_ics_game(long game_num) {
+	int i;
+	for (i = 0; i < ics_games_count; i++) {
+		if (ics_games[i]->game_num == game_num) {
+			return ics_games[i];
+		}
+	}
+	return NULL;
+}
+
+static void remove_ics_game(ics_game *g) {
+	int i;
+	for (i = 0; i < ics_games_count; i++) {
+		if (ics_games[i] == g) {
+			ics_games[i] = ics_games[--ics_games_count];
+			break;
+		}
+	}
+	if (move_list_game == g) {
+		move_list_game = NULL;
+	}
+	if (!g->displayed) {
+		game_free(g->game);
+		plys_list_free(g->list);
+	}
+	free(g);
+}
+
+/* The game on the board, if it is still the one in my_game */
+static ics_game *find_displayed_game(void) {
+	int i;
+	for (i = 0; i < ics_games_count; i++) {
+		ics_game *g = ics_games[i];
+		if (!g->displayed) {
+			continue;
+		}
+		if (g->game_num != my_game) {
+			// the board moved on without telling us
+			remove_ics_game(g);
+			return NULL;
+		}
+		return g;
+	}
+	return NULL;
+}
+
+/* Start following a game, on the board or off screen */
+static ics_game *add_ics_game(long game_num, bool displayed) {
+	ics_game *g = find_ics_game(game_num);
+	if (g != NULL) {
+		return g;
+	}
+	if (displayed) {
+		ics_game *shown = find_displayed_game();
+		if (shown != NULL) {
+			remove_ics_game(shown);
+		}
+	}
+	if (ics_games_count == MAX_ICS_GAMES) {
+		fprintf(stderr, "Already following %d games, ignoring game %ld\n", MAX_ICS_GAMES, game_num);
+		return NULL;
+	}
+
+	g = calloc(1, sizeof(ics_game));
+	if (!g) {
+		perror("Calloc failed!!");
+		exit(1);
+	}
+	g->game_num = game_num;
+	g->displayed = displayed;
+	if (!displayed) {
+		g->game = game_new();
+		reset_position(g->game);
+		g->list = plys_list_new();
+	}
+	ics_games[ics_games_count++] = g;
+	debug("Following game %ld (%s), %d games\n", game_num, displayed ? "on the board" : "off screen", ics_games_count);
+	return g;
+}
+
+static void remove_all_ics_games(void) {
+	while (ics_games_count) {
+		remove_ics_game(ics_games[ics_games_count - 1]);
+	}
+}
+
+/* Set up a position straight from the board and state of a style 12 line */
+static void load_style12_position(chess_game *game, style12 *b) {
+	int next_slot[2] = {0, 0};
+	int i, j;
+
+	for (i = 0; i < 16; i++) {
+		game->white_set[i].dead = true;
+		game->black_set[i].dead = true;
+	}
+	memset(game->squares, 0, sizeof(game->squares));
+
+	for (j = 0; j < 8; j++) {
+		// the first rank in the line is the 8th
+		const char *rank = b->ranks[7 - j];
+		for (i = 0; i < 8; i++) {
+			if (rank[i] == '-') {
+				continue;
 			}
+			bool colour = islower(rank[i]) ? BLACK : WHITE;
+			chess_piece *set = colour ? game->black_set : game->white_set;
+			int piece_type = char_to_type(colour, toupper(rank[i]));
+			int slot;
+			if ((piece_type == W_KING || piece_type == B_KING) && set[KING].dead) {
+				slot = KING;
+			} else {
+				if (next_slot[colour] == KING) {
+					next_slot[colour]++;
+				}
+				slot = next_slot[colour]++;
+			}
+			if (slot > ROOK2) {
+				debug("Too many pieces in style 12 board, skipping '%c'\n", rank[i]);
+				continue;
+			}
+			set[slot].type = piece_type;
+			set[slot].dead = false;
+			set[slot].colour = colour;
+			set[slot].pos.column = i;
+			set[slot].pos.row = j;
+			game->squares[i][j].piece = &set[slot];
+		}
+	}
+
+	game->whose_turn = (b->to_play == 'B');
+	game->castle_state[0][0] = b->castle_wl;
+	game->castle_state[0][1] = b->castle_ws;
+	game->castle_state[1][0] = b->castle_bl;
+	game->castle_state[1][1] = b->castle_bs;
+	init_en_passant(game);
+	if (b->double_push >= 0 && b->double_push < 8) {
+		game->en_passant[b->double_push] = 1;
+	}
+	game->fifty_move_counter = 100 - b->fifty_move_count;
+	game->current_move_number = b->move_num;
+	game->ply_num = 2 * (b->move_num - 1) + game->whose_turn + 1;
+	init_hash(game);
+}
+
+/* e.g. "P/e7-e8=Q", "N/g1-f3" or "o-o-o". colour is the side that moved.
+ * promo_type is -1 unless it was a promotion */
+static bool parse_verbose_move(const char *verbose, bool colour, int move[4], int *promo_type) {
+	int row = colour ? 7 : 0;
+	*promo_type = -1;
+	if (!strcmp(verbose, "o-o")) {
+		move[0] = 4; move[1] = row; move[2] = 6; move[3] = row;
+		return true;
+	}
+	if (!strcmp(verbose, "o-o-o")) {
+		move[0] = 4; move[1] = row; move[2] = 2; move[3] = row;
+		return true;
+	}
+	if (strlen(verbose) < 7 || verbose[1] != '/' || verbose[4] != '-') {
+		return false;
+	}
+	move[0] = verbose[2] - 'a';
+	move[1] = verbose[3] - '1';
+	move[2] = verbose[5] - 'a';
+	move[3] = verbose[6] - '1';
+	for (row = 0; row < 4; row++) {
+		if (move[row] < 0 || move[row] > 7) {
+			return false;
 		}
+	}
+	if (verbose[7] == '=') {
+		*promo_type = char_to_type(colour, verbose[8]);
+	}
+	return true;
+}
 
-		/* NOTE: on ICS the clock starts after black's first move.
-		 * This is for obvious reasons due to the nature of online games
-		 * and the challenging/seek system.
-		 * This is different from the official FIDE chess rules which state that:
-		 * "At the time determined for the start of the game, the clock of the
-		 * player who has the white pieces is started.*/
-		if ( !clock_started && moveNum == 2 && relation && game_started && to_play == 'W' ) {
-			start_one_clock(main_clock, 0);
+/* Hand the move of a displayed board over for playing, with its squares
+ * so it doesn't have to be resolved from the SAN */
+static void set_style12_last_move(style12 *b) {
+	int move[4];
+	int promo_type;
+	if (parse_verbose_move(b->verbose_move, b->to_play == 'W', move, &promo_type)) {
+		set_last_move_squares(b->san_move, move, promo_type);
+	} else {
+		set_last_move(b->san_move);
+	}
+}
+
+/* A new board for a game that is not displayed: take the position as it
+ * is and append the ply that led to it */
+static void update_background_game(ics_game *g, style12 *b) {
+	int move[4];
+	int promo_type;
+	// plys played before this board
+	int plys = 2 * (b->move_num - 1) + (b->to_play == 'B');
+
+	if (g->finished_parsing_moves && g->list->last_ply < plys &&
+	    parse_verbose_move(b->verbose_move, b->to_play == 'W', move, &promo_type)) {
+		plys_list_append_ply(g->list, ply_new(move[0], move[1], move[2], move[3], NULL, b->san_move));
+	}
+	// the move list being replayed has the position
+	if (!g->got_header) {
+		load_style12_position(g->game, b);
+	}
+}
+
+int parse_board12(char *string_chunk) {
+	style12 b;
+	int i;
+
+	debug("Board 12 string: '%s'\n", string_chunk);
+
+	int bad_field = tokenize_style12(string_chunk, &b);
+	if (bad_field > -1) {
+		fprintf(stderr, "FAILED to parse Board 12 String: bad or missing %s field (#%d)\n",
+		        style12_field_names[bad_field], bad_field + 1);
+		return -1;
+	}
+
+	debug("Successfully parsed Board 12:\n");
+	debug("\tBlack's name: %s\n", b.b_name);
+	debug("\tWhite's name: %s\n", b.w_name);
+	debug("\tIt is %s's move\n", (b.to_play == 'B' ? "Black" : "White"));
+	debug("\tWhite's time: %ds\n", b.white_time);
+	debug("\tBlack's time: %ds\n", b.black_time);
+	debug("\tMy relation: %d\n", b.relation);
+	debug("\tSAN move: '%s'\n\n", b.san_move);
+
+	ics_game *g = find_ics_game(b.gamenum);
+	if (g == NULL && (b.relation == 1 || b.relation == -1)) {
+		// one of my games whose start we missed
+		g = add_ics_game(b.gamenum, true);
+	}
+	if (g == NULL) {
+		debug("Ignoring board for game %d\n", b.gamenum);
+		return 0;
+	}
+	g->white_time = b.white_time;
+	g->black_time = b.black_time;
+	if (!g->displayed) {
+		update_background_game(g, &b);
+		return 0;
+	}
+
+	// keep the board as it came, ranks separated by a space, to check our
+	// own position against once the move is played
+	memset(last_board_chars, 0, sizeof(last_board_chars));
+	for (i = 0; i < 8; i++) {
+		memcpy(last_board_chars + i * 9, b.ranks[i], 8);
+		if (i < 7) {
+			last_board_chars[i * 9 + 8] = ' ';
+		}
+	}
+	debug("\tBoard chars: '%s'\n", last_board_chars);
+
+	// Did we ask for times?
+	if (g->requested_times) {
+		g->requested_times = 0;
+		update_clocks(main_clock, b.white_time, b.black_time, true);
+		if (!clock_started && b.move_num >= 2) {
 			clock_started = 1;
+			start_one_clock(main_clock, (b.to_play == 'W')?0:1);
+			debug("start clock\n");
 		}
+		return 0;
+	}
 
-		/*
-		 * my relation to this game:
-		 *     -3 isolated position, such as for "ref 3" or the "sposition" command
-		 *     -2 I am observing game being examined
-		 *      2 I am the examiner of this game
-		 *     -1 I am playing, it is my opponent's move
-		 *      1 I am playing and it is my move
-		 *      0 I am observing a game being played
-		 * */
-		switch (relation) {
-			case 1:
-				if (!strncmp("none", san_move, 4)) {
-					break;
-				}
-				debug("Emitting got-move signal while playing\n");
-				g_signal_emit_by_name(board, "got-move");
+	// game and clocks started: update the clocks
+	if (game_started && clock_started) {
+		update_clocks(main_clock, b.white_time, b.black_time, true);
+	}
+
+	// game started and not observing: set last move and swap clocks if needed
+	if (game_started && b.relation) {
+		set_style12_last_move(&b);
+		if (clock_started) {
+			start_one_stop_other_clock(main_clock, (b.to_play == 'W') ? 0 : 1, true);
+		}
+	}
+
+	/* NOTE: on ICS the clock starts after black's first move.
+	 * This is for obvious reasons due to the nature of online games
+	 * and the challenging/seek system.
+	 * This is different from the official FIDE chess rules which state that:
+	 * "At the time determined for the start of the game, the clock of the
+	 * player who has the white pieces is started.*/
+	if ( !clock_started && b.move_num == 2 && b.relation && game_started && b.to_play == 'W' ) {
+		start_one_clock(main_clock, 0);
+		clock_started = 1;
+	}
+
+	/*
+	 * my relation to this game:
+	 *     -3 isolated position, such as for "ref 3" or the "sposition" command
+	 *     -2 I am observing game being examined
+	 *      2 I am the examiner of this game
+	 *     -1 I am playing, it is my opponent's move
+	 *      1 I am playing and it is my move
+	 *      0 I am observing a game being played
+	 * */
+	switch (b.relation) {
+		case 1:
+			if (!strncmp("none", b.san_move, 4)) {
 				break;
-			case 0:
-			case -2:
-			case 2:
-				if (clock_started) {
-					debug("Swapping clocks here\n");
-					start_one_stop_other_clock(main_clock, (to_play == 'W') ? 0 : 1, true);
+			}
+			debug("Emitting got-move signal while playing\n");
+			g_signal_emit_by_name(board, "got-move");
+			break;
+		case 0:
+		case -2:
+		case 2:
+			if (clock_started) {
+				debug("Swapping clocks here\n");
+				start_one_stop_other_clock(main_clock, (b.to_play == 'W') ? 0 : 1, true);
+			}
+			if (b.gamenum == my_game && g->finished_parsing_moves) {
+				if (!game_started) {
+					game_started = true;
 				}
-				if (gamenum == my_game && finished_parsing_moves) {
-					if (!game_started) {
-						game_started = true;
-					}
-					if (!clock_started && moveNum >= 2) {
-						clock_started = 1;
-						update_clocks(main_clock, white_time, black_time, true);
-						debug("Starting a clock here\n");
-						start_one_clock(main_clock, (to_play == 'W') ? 0 : 1);
-					}
-					set_last_move(san_move);
-					debug("Emitting got-move signal while observing\n");
-					g_signal_emit_by_name(board, "got-move");
+				if (!clock_started && b.move_num >= 2) {
+					clock_started = 1;
+					update_clocks(main_clock, b.white_time, b.black_time, true);
+					debug("Starting a clock here\n");
+					start_one_clock(main_clock, (b.to_play == 'W') ? 0 : 1);
 				}
-				break;
-			default:
-				break;
-		}
+				set_style12_last_move(&b);
+				debug("Emitting got-move signal while observing\n");
+				g_signal_emit_by_name(board, "got-move");
+			}
+			break;
+		default:
+			break;
 	}
 	return 0;
 }
@@ -591,10 +974,10 @@ int parse_resume_message(char *message, long *game_num, char w_name[128], char b
 }
 
 int am_interested_in_game(long game_num) {
-	return game_num == my_game;
+	return find_ics_game(game_num) != NULL;
 }
 
-int parse_end_message(char *message, char end_token[32]) {
+int parse_end_message(char *message, long *game_num, char end_token[32]) {
 
 	if (ics_scanner_leng < 5) {
 		fprintf(stderr, "Bug in ICS parser, token length for Start message should be more than 5\n");
@@ -603,21 +986,20 @@ int parse_end_message(char *message, char end_token[32]) {
 
 	char w_name[128];
 	char b_name[128];
-	long game_num;
 	memset(w_name, 0, 128);
 	memset(b_name, 0, 128);
 
 	int ret = 0;
 
 	char *first_space;
-	game_num = strtol(message+5, &first_space, 10);
-	if (!am_interested_in_game(game_num)) {
+	*game_num = strtol(message+5, &first_space, 10);
+	if (!am_interested_in_game(*game_num)) {
 		// ignore this message
-		debug("Ignoring endmessage for game %ld\n", game_num);
+		debug("Ignoring endmessage for game %ld\n", *game_num);
 		return 0;
 	}
-	if (game_num > 0) {
-		debug("Got game number %ld\n", game_num);
+	if (*game_num > 0) {
+		debug("Got game number %ld\n", *game_num);
 		ret++;
 	}
 
@@ -997,7 +1379,80 @@ void toggle_echo(int on_off) {
 	}
 }
 
-int scan_append_ply(char *ply) {
+/* Find the squares of a move list ply for a game that is not on the board.
+ * The SAN scanner reads and writes main_game, so this does without it.
+ * promo_type is -1 unless it is a promotion */
+static bool resolve_background_san(chess_game *game, const char *san, int move[4], int *promo_type) {
+	char squares[8];
+	char target[5];
+	int piece_type = colorise_type(W_PAWN, game->whose_turn);
+	int n = 0;
+
+	*promo_type = -1;
+	if (!strncmp(san, "O-O-O", 5) || !strncmp(san, "O-O", 3)) {
+		snprintf(target, sizeof(target), "%c%c", san[3] == '-' ? 'c' : 'g', game->whose_turn ? '8' : '1');
+		return resolve_move(game, colorise_type(W_KING, game->whose_turn), target, move) != 0;
+	}
+	if (*san && strchr("KQRBN", *san)) {
+		piece_type = char_to_type(game->whose_turn, *san++);
+	}
+	for (; *san && !strchr("+#!?", *san); san++) {
+		if (*san == '=') {
+			*promo_type = char_to_type(game->whose_turn, san[1]);
+			break;
+		}
+		if (*san != 'x' && *san != '-' && n < (int) sizeof(squares)) {
+			squares[n++] = *san;
+		}
+	}
+
+	// what resolve_move() takes: the destination, after a full origin
+	// where one of its column or row may be unknown
+	switch (n) {
+		case 2:
+			snprintf(target, sizeof(target), "%c%c", squares[0], squares[1]);
+			break;
+		case 3:
+			if (isdigit((unsigned char) squares[0])) {
+				snprintf(target, sizeof(target), "%c%c%c%c", 'a' - 1, squares[0], squares[1], squares[2]);
+			} else {
+				snprintf(target, sizeof(target), "%c%c%c%c", squares[0], '1' - 1, squares[1], squares[2]);
+			}
+			break;
+		case 4:
+			snprintf(target, sizeof(target), "%c%c%c%c", squares[0], squares[1], squares[2], squares[3]);
+			break;
+		default:
+			return false;
+	}
+	return resolve_move(game, piece_type, target, move) != 0;
+}
+
+/* Play a move list ply on a game that is not on the board */
+static void append_background_ply(ics_game *g, const char *ply) {
+	chess_game *game = g->game;
+	int move[4];
+	int promo_type;
+	char san_move[SAN_MOVE_SIZE];
+
+	if (!resolve_background_san(game, ply, move, &promo_type)) {
+		fprintf(stderr, "Could not resolve move %s in game %ld\n", ply, g->game_num);
+		return;
+	}
+	chess_piece *piece = game->squares[move[0]][move[1]].piece;
+	game->promo_type = promo_type != -1 ? promo_type : colorise_type(W_QUEEN, game->whose_turn);
+	move_piece(piece, move[2], move[3], 0, AUTO_SOURCE_NO_ANIM, san_move, game, true);
+	if (is_king_checked(game, game->whose_turn)) {
+		san_move[strlen(san_move)] = is_check_mate(game) ? '#' : '+';
+	}
+	plys_list_append_ply(g->list, ply_new(move[0], move[1], move[2], move[3], NULL, san_move));
+}
+
+int scan_append_ply(ics_game *g, char *ply) {
+	if (!g->displayed) {
+		append_background_ply(g, ply);
+		return FALSE;
+	}
 	san_scanner__scan_string(ply);
 	if (san_scanner_lex() != -1) {
 		playing = 1;
@@ -1040,7 +1495,7 @@ int scan_append_ply(char *ply) {
 /* e.g.
   1.  Nf3     (0:00)
 */
-int parse_move_list_white_ply(char *message) {
+int parse_move_list_white_ply(ics_game *g, char *message) {
 	char w_ply[SAN_MOVE_SIZE];
 	memset(w_ply, 0, SAN_MOVE_SIZE);
 	char *first_space;
@@ -1050,7 +1505,7 @@ int parse_move_list_white_ply(char *message) {
 	char *second_space = strchr(first_space, ' ');
 	if (second_space) {
 		memcpy(w_ply, first_space, second_space-first_space);
-		scan_append_ply(w_ply);
+		scan_append_ply(g, w_ply);
 	}
 	return 0;
 }
@@ -1058,7 +1513,7 @@ int parse_move_list_white_ply(char *message) {
 /* e.g.
   4.  exd5    (0:00)     exd5    (0:05)
 */
-int parse_move_list_full_move(char *message) {
+int parse_move_list_full_move(ics_game *g, char *message) {
 
 	char w_ply[SAN_MOVE_SIZE];
 	char b_ply[SAN_MOVE_SIZE];
@@ -1078,7 +1533,7 @@ int parse_move_list_full_move(char *message) {
 	char *second_space = strchr(first_space, ' ');
 	if (second_space) {
 		memcpy(w_ply, first_space, second_space-first_space);
-		scan_append_ply(w_ply);
+		scan_append_ply(g, w_ply);
 	}
 
 	// inc second_space till first non-space character
@@ -1088,7 +1543,7 @@ int parse_move_list_full_move(char *message) {
 	char *fourth_space = strchr(third_space, ' ');
 	if (fourth_space) {
 		memcpy(b_ply, third_space, fourth_space-third_space);
-		scan_append_ply(b_ply);
+		scan_append_ply(g, b_ply);
 	}
 	return 0;
 }
@@ -1103,135 +1558,48 @@ gboolean is_printable(char c) {
 	return FALSE;
 }
 
-void parse_ics_buffer(void) {
-
-	static int chopped_len = 0;
-
-	int i,j;
-	char raw_buff[ICS_BUFF_SIZE];
-
-
-	static char *buff;
-	static int current_buff_alloc = 0;
-
-	memset(raw_buff, 0, ICS_BUFF_SIZE);
-
-	// read at most ICS_BUFF_SIZE bytes from the ICS pipe
-	int nread = read(ics_data_pipe[0], &raw_buff, ICS_BUFF_SIZE);
-	if (nread < 1) {
-		fprintf(stderr, "ERROR: failed to read data from ICS pipe\n");
-	}
-
-	// Uncomment following block to generate a log of the raw FICS output
-	/*
-	char log_buff[ICS_BUFF_SIZE];
-	memset(log_buff, 0, ICS_BUFF_SIZE);
-	memcpy(log_buff, raw_buff, nread);
-	FILE *log_file = fopen("log_cairo.txt", "a+");
-	fprintf(log_file,"%s", log_buff);
-	fclose(log_file);
-	*/
-
-	/* *
-	 * Check if the case where a truncated line starts our buffer
-	 * actually happens (should never happen with a buffer size greater than 512)
-	 * */
-	if (raw_buff[0] == '\\') {
-		debug("Raw Buffer started with a truncated line!!\n");
-	}
-
-	/* adjust the memory allocated to buff to match just what we need */
-	int new_alloc = nread + chopped_len +1; // allocate 1 extra to NULL terminate
-	if (current_buff_alloc != new_alloc) {
-		/* realloc might move the pointer so use a temp address */
-		char *temp = realloc(buff-chopped_len, new_alloc);
+/* Make sure a scratch buffer reused across lines holds at least len bytes */
+static char *reserve_scratch(char **buff, size_t *alloc, size_t len) {
+	if (len > *alloc) {
+		size_t new_alloc = *alloc ? *alloc : 256;
+		while (new_alloc < len) {
+			new_alloc *= 2;
+		}
+		char *temp = realloc(*buff, new_alloc);
 		if (!temp) {
 			perror("Realloc failed!!");
 			exit(1);
 		}
-		/* assign the right address to buff */
-		buff = temp+chopped_len;
-		current_buff_alloc = new_alloc;
+		*buff = temp;
+		*alloc = new_alloc;
 	}
+	return *buff;
+}
 
+static void post_append(const char *text) {
+	size_t len = strlen(text);
+	reserve_scratch(&post_buff, &post_alloc, post_len + len);
+	memcpy(post_buff + post_len, text, len);
+	post_len += len;
+}
 
-	/* memset buff to 0 without overwriting the chopped bit that is before */
-	memset(buff, 0, nread+1);
-
-
-	/* Remove NULLs and \r which confuse the hell out of flex.
-	 * If some variable is set, FICS will also send 0x7 (bell) characters
-	 * to notifiy of a move, we filter that out here as well */
-	j = 0;
-	for (i = 0; i < nread; i++) {
-		if ( raw_buff[i] != 0 && raw_buff[i] != '\r' && raw_buff[i] != 0x7 ) {
-			buff[j] = raw_buff[i];
-			j++;
-		}
+static void flush_ics_console(void) {
+	if (post_len) {
+		fwrite(post_buff, 1, post_len, stdout);
+		fflush(stdout);
+		post_len = 0;
 	}
-	/* NB: buff is still NULL terminated */
-
-	/////////////
-	/* Remove line truncation marks and stitch them */
-	/* NB: buff is still NULL terminated */
-	/////////////
-
-	if (chopped_len) {
-		buff -= chopped_len;
-		chopped_len = 0;
-	}
-
-	/* Detect a chopped line if the last character in the buffer
-	 * is not a \n.
-	 * If a chopped line is detected, chopped_len is set appropriately
-	 * and we copy the chopped bit to the next scanned buff*/
-	char *buff_end = strchr(buff, '\0') - 1; // first null is end of string
-	if (*buff_end != '\n') {
-		/* The only exceptions to this are the fics, login and password prompts.
-		 * These are valid expected chopped lines which we don't want to reparse */
-		char *last_endline = strrchr(buff, '\n'); // get last endline
-		if (last_endline == NULL) {
-			last_endline = buff-1;
-		}
-		if (!memcmp(last_endline+1, "fics% ", 6)) {
-			//debug("DETECTED FICS PROMPT\n");
-		}
-		else if (!memcmp(last_endline+1, "login: ", 7)) {
-			//debug("DETECTED LOGIN PROMPT\n");
-		}
-		else if (!memcmp(last_endline+1, "password: ", 10)) {
-			//debug("DETECTED PASSWORD PROMPT\n");
-		}
-		else {
-			/* Detected a chopped line */
-			chopped_len = buff_end - last_endline;
-
-			/* grab chopped bit */
-			char *chopped_bit = malloc(chopped_len);
-			memcpy(chopped_bit, last_endline + 1, chopped_len);
-
-			/* slide buff */
-			memmove(buff+chopped_len, buff, (buff_end-buff + 1)-chopped_len);
-			/* NB: buff is still NULL terminated after slide */
+}
 
-			/* copy the chopped bit back to the beginning of buff */
-			memcpy(buff, chopped_bit, chopped_len);
-			free(chopped_bit);
+/* Scan one whole line from the ICS, len excludes the two NULs that
+ * terminate it which flex uses in place as its end of buffer marks */
+static void parse_ics_line(char *line, size_t len) {
 
-			/* move buff pointer to the beginning of the unchopped data
-			 * This means we won't parse the chopped bit this time round */
-			buff += chopped_len;
-		}
-	}
-	else {
-		/* Buffer ended by newline */
-		chopped_len = 0;
-	}
-
-	char *post_buff = calloc(current_buff_alloc-chopped_len+1, sizeof(char));
+	int i;
+	size_t line_start = post_len;
 
+	YY_BUFFER_STATE scan_state = ics_scanner__scan_buffer(line, len + 2);
 
-	ics_scanner__scan_bytes(buff, current_buff_alloc-chopped_len);
 	i = 0;
 	while (i > -1) {
 
@@ -1253,16 +1621,14 @@ void parse_ics_buffer(void) {
 			case GAME_END:
 			case FOLLOWING:
 			default:
-				strcat(post_buff, ics_scanner_text);
+				post_append(ics_scanner_text);
 				break;
 		}
 
 		switch (i) {
 			case BOARD_12:
 				debug("DEBUG got board12\n");
-				if (parse_board12(ics_scanner_text+5) > 0) {
-					fprintf(stderr, "Failed to parse board12: '%s'\n", ics_scanner_text);
-				}
+				parse_board12(ics_scanner_text+5);
 				break;
 			case FICS_PROMPT:
 				if (my_channels_requested && got_my_channels_header) {
@@ -1283,25 +1649,25 @@ void parse_ics_buffer(void) {
 				}
 				break;
 			case CHANNEL_CHAT: {
-				last_message = calloc(ics_scanner_leng + 1, sizeof(char));
+				reserve_scratch(&last_message, &last_message_alloc, ics_scanner_leng + 1);
 				memset(last_user, 0, 32);
 				last_channel_number = parse_channel_chat(ics_scanner_text, last_user, last_message);
 				insert_text_channel_view(last_channel_number, last_user, last_message, TRUE);
-				free(last_message);
 				break;
 			}
 			case PRIVATE_TELL: {
-				last_message = calloc(ics_scanner_leng + 1, sizeof(char));
+				reserve_scratch(&last_message, &last_message_alloc, ics_scanner_leng + 1);
 				memset(last_user, 0, 32);
 				parse_private_tell(ics_scanner_text, last_user, last_message);
 				insert_text_channel_view(last_channel_number, last_user, last_message, TRUE);
-				free(last_message);
 				break;
 			}
 			case LOGIN_PROMPT:
 				debug("DEBUG prompted for login\n");
 				ics_logged_in = false;
-				show_login_dialog(true);
+				if (!ics_replaying) {
+					show_login_dialog(true);
+				}
 				break;
 			case CONFIRM_GUEST_LOGIN_PROMPT:
 				debug("DEBUG prompted for confirming login\n");
@@ -1321,35 +1687,40 @@ void parse_ics_buffer(void) {
 			case GOT_LOGIN:
 				/* successful login! */
 				ics_logged_in = true;
-				gdk_threads_enter();
-				if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(save_login))) {
-					set_save_login(TRUE);
-					set_login(gtk_entry_get_text(GTK_ENTRY(login)));
-					set_password(gtk_entry_get_text(GTK_ENTRY(password)));
-					if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(auto_login))) {
-						set_auto_login(TRUE);
+				if (!ics_replaying) {
+					gdk_threads_enter();
+					if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(save_login))) {
+						set_save_login(TRUE);
+						set_login(gtk_entry_get_text(GTK_ENTRY(login)));
+						set_password(gtk_entry_get_text(GTK_ENTRY(password)));
+						if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(auto_login))) {
+							set_auto_login(TRUE);
+						}
+						else {
+							set_auto_login(FALSE);
+						}
 					}
 					else {
+						set_save_login(FALSE);
 						set_auto_login(FALSE);
 					}
-				}
-				else {
-					set_save_login(FALSE);
-					set_auto_login(FALSE);
-				}
 
-				close_login_dialog(false);
+					close_login_dialog(false);
 
-				gdk_threads_leave();
+					gdk_threads_leave();
 
-				save_config();
+					save_config();
+				}
 
 				memset(my_handle, 0, sizeof(my_handle));
 				strcpy(my_handle, ics_scanner_text);
 				debug("DEBUG got handle for this session: '%s'\n", my_handle);
 
+				// one write for the whole lot
+				hold_fics_output();
 				set_fics_variables();
 				request_my_channels();
+				release_fics_output();
 
 				break;
 
@@ -1422,6 +1793,11 @@ void parse_ics_buffer(void) {
 					}
 
 					my_game = game_num;
+					ics_game *g = add_ics_game(game_num, true);
+					if (g != NULL) {
+						g->init_time = init_time;
+						g->increment = increment;
+					}
 
 					memset(main_game->white_name, 0, sizeof(main_game->white_name));
 					memset(main_game->black_name, 0, sizeof(main_game->black_name));
@@ -1466,17 +1842,21 @@ void parse_ics_buffer(void) {
 			}
 			case GAME_END: {
 				char end_token[32];
-				if (parse_end_message(ics_scanner_text, end_token) == 4) {
-
-					char bufstr[33];
-					if (!main_game->whose_turn) {
-						snprintf(bufstr, 33, "\t%s", end_token);
-					}
-					else {
-						strncpy(bufstr, end_token, 32);
+				long game_num;
+				if (parse_end_message(ics_scanner_text, &game_num, end_token) == 4) {
+					ics_game *g = find_ics_game(game_num);
+					if (g->displayed) {
+						char bufstr[33];
+						if (!main_game->whose_turn) {
+							snprintf(bufstr, 33, "\t%s", end_token);
+						}
+						else {
+							strncpy(bufstr, end_token, 32);
+						}
+						insert_text_moves_list_view(bufstr, true);
+						end_game();
 					}
-					insert_text_moves_list_view(bufstr, true);
-					end_game();
+					remove_ics_game(g);
 				}
 //				if (crafty_mode) {
 //					write_to_crafty("force\n");
@@ -1496,10 +1876,22 @@ void parse_ics_buffer(void) {
 			case OBSERVE_START: {
 				long obs_game = parse_observe_start_message(ics_scanner_text);
 				debug("Found Observe start for game %ld\n", obs_game);
-				if (my_game && my_game != obs_game) {
-					debug("my_game != obs_game!!\n");
+				ics_game *shown = find_displayed_game();
+				if (shown == NULL || shown->game_num == obs_game) {
+					add_ics_game(obs_game, true);
+					my_game = obs_game;
+				} else {
+					debug("Game %ld is on the board, following game %ld off screen\n", shown->game_num, obs_game);
+					add_ics_game(obs_game, false);
+				}
+				break;
+			}
+			case OBSERVE_END: {
+				// Removing game 42 from observation list.
+				ics_game *g = find_ics_game(strtol(ics_scanner_text + 14, NULL, 10));
+				if (g != NULL) {
+					remove_ics_game(g);
 				}
-				my_game = obs_game;
 				break;
 			}
 			case OBSERVE_HEADER: {
@@ -1514,87 +1906,120 @@ void parse_ics_buffer(void) {
 				memset(w_rating, 0, 5);
 				memset(b_rating, 0, 5);
 				gboolean rated;
-				parse_observe_header(ics_scanner_text, &game_num, w_name, b_name, w_rating, b_rating, &rated, &init_time, &increment);
-				if (my_game != game_num) {
-					debug("my_game != game_num!!\n");
+				int obs_init_time, obs_increment;
+				parse_observe_header(ics_scanner_text, &game_num, w_name, b_name, w_rating, b_rating, &rated, &obs_init_time, &obs_increment);
+				ics_game *g = find_ics_game(game_num);
+				if (g == NULL) {
+					debug("Observe header for game %ld we don't follow\n", game_num);
+					break;
 				}
-				char name1[256];
-				char name2[256];
-				memset(name1, 0, 256);
-				memset(name2, 0, 256);
-				sprintf(name1, "%s (%s)", w_name, w_rating);
-				sprintf(name2, "%s (%s)", b_name, b_rating);
-				start_game(name1, name2, init_time * 60, increment, 0, true);
-				start_new_uci_game(init_time * 60, ENGINE_ANALYSIS);
-				if (!strcmp(b_name, following_player) && !is_board_flipped() || !strcmp(w_name, following_player) && is_board_flipped()) {
-					g_signal_emit_by_name(board, "flip-board");
+				g->init_time = obs_init_time;
+				g->increment = obs_increment;
+				if (g->displayed) {
+					char name1[256];
+					char name2[256];
+					memset(name1, 0, 256);
+					memset(name2, 0, 256);
+					sprintf(name1, "%s (%s)", w_name, w_rating);
+					sprintf(name2, "%s (%s)", b_name, b_rating);
+					start_game(name1, name2, g->init_time * 60, g->increment, 0, true);
+					start_new_uci_game(g->init_time * 60, ENGINE_ANALYSIS);
+					if (!strcmp(b_name, following_player) && !is_board_flipped() || !strcmp(w_name, following_player) && is_board_flipped()) {
+						g_signal_emit_by_name(board, "flip-board");
+					}
+				} else {
+					snprintf(g->game->white_name, sizeof(g->game->white_name), "%s (%s)", w_name, w_rating);
+					snprintf(g->game->black_name, sizeof(g->game->black_name), "%s (%s)", b_name, b_rating);
 				}
-				requested_times = 1;
+				g->requested_times = 1;
 				char request_moves[16];
 				snprintf(request_moves, 16, "moves %ld\n", game_num);
-				requested_moves = 1;
-				finished_parsing_moves = 0;
+				g->requested_moves = 1;
+				g->finished_parsing_moves = 0;
 				send_to_ics(request_moves);
 				break;
 			}
-			case MOVE_LIST_START:
+			case MOVE_LIST_START: {
 				debug("Found Movelist start: '%s'\n", ics_scanner_text);
-				if (!requested_moves) {
+				// Movelist for game 42:
+				ics_game *g = find_ics_game(strtol(ics_scanner_text + 18, NULL, 10));
+				if (g == NULL || !g->requested_moves) {
 					debug("Found Movelist start but we didn't ask for any moves?: '%s'\n", ics_scanner_text);
 				} else {
-					parsed_plys = 0;
-					got_header = 1;
+					if (!g->displayed) {
+						// replayed from the start
+						reset_position(g->game);
+						plys_list_free(g->list);
+						g->list = plys_list_new();
+					}
+					g->parsed_plys = 0;
+					g->got_header = 1;
+					move_list_game = g;
 				}
 				break;
+			}
 			case MOVE_LIST_WHITE_PLY:
-				if (requested_moves && got_header) {
-					parsed_plys++;
-					parse_move_list_white_ply(ics_scanner_text);
+				if (move_list_game && move_list_game->got_header) {
+					move_list_game->parsed_plys++;
+					parse_move_list_white_ply(move_list_game, ics_scanner_text);
 				}
 				break;
 			case MOVE_LIST_FULL_MOVE:
-				if (requested_moves && got_header) {
-					parsed_plys += 2;
-					parse_move_list_full_move(ics_scanner_text);
+				if (move_list_game && move_list_game->got_header) {
+					move_list_game->parsed_plys += 2;
+					parse_move_list_full_move(move_list_game, ics_scanner_text);
 				}
 				break;
-			case MOVE_LIST_END:
-				got_header = 0;
-				requested_moves = 0;
-				finished_parsing_moves = 1;
+			case MOVE_LIST_END: {
+				ics_game *g = move_list_game;
+				if (g == NULL) {
+					break;
+				}
+				move_list_game = NULL;
+				g->got_header = 0;
+				g->requested_moves = 0;
+				g->finished_parsing_moves = 1;
+				if (!g->displayed) {
+					debug("Replayed %d plys of game %ld off screen\n", g->parsed_plys, g->game_num);
+					break;
+				}
 
 				refresh_moves_list_view(main_list);
 				gdk_threads_enter();
 				draw_pieces_surface(old_wi, old_hi);
-				init_dragging_background(old_wi, old_hi);
 				init_highlight_under_surface(old_wi, old_hi);
 //				init_highlight_over_surface(old_wi, old_hi);
 
 				// highlight last move
-				if (parsed_plys > 0 && highlight_last_move) {
+				if (g->parsed_plys > 0 && highlight_last_move) {
 					highlight_move(resolved_move[0], resolved_move[1], resolved_move[2], resolved_move[3], old_wi, old_hi);
 				}
-				if (parsed_plys > 0 && is_king_checked(main_game, main_game->whose_turn)) {
+				if (g->parsed_plys > 0 && is_king_checked(main_game, main_game->whose_turn)) {
 					warn_check(old_wi, old_hi);
 				}
 
-				gtk_widget_queue_draw(GTK_WIDGET(board));
+				// all pieces may have moved
+				mark_all_squares_dirty();
+				flush_dirty_squares(old_wi, old_hi);
 				gdk_threads_leave();
-				if (parsed_plys > 1 && !clock_started) {
+				if (g->parsed_plys > 1 && !clock_started) {
 					clock_started = 1;
 					start_one_clock(main_clock, (main_game->whose_turn));
 				}
 				start_uci_analysis();
 				break;
+			}
 			case GAME_RESUME: {
 				debug("Found GAME_RESUME message: '%s'\n", ics_scanner_text);
 				char wn[128], bn[128];
 				memset(wn, 0, 128);
 				memset(bn, 0, 128);
 				long game_num;
+				ics_game *g = NULL;
 				if (parse_resume_message(ics_scanner_text, &game_num, wn, bn) == 3) {
 					debug("Successfully parsed start message: game number and white/black name\n");
 					my_game = game_num;
+					g = add_ics_game(game_num, true);
 				}
 
 				/////
@@ -1619,11 +2044,16 @@ void parse_ics_buffer(void) {
 					requested_start = 0;
 				}
 				/////
-				requested_times = 1;
+				if (g == NULL) {
+					break;
+				}
+				g->init_time = init_time;
+				g->increment = increment;
+				g->requested_times = 1;
 				char request_moves[16];
 				snprintf(request_moves, 16, "moves %ld\n", game_num);
-				requested_moves = 1;
-				finished_parsing_moves = 0;
+				g->requested_moves = 1;
+				g->finished_parsing_moves = 0;
 				send_to_ics(request_moves);
 				break;
 			}
@@ -1653,27 +2083,61 @@ void parse_ics_buffer(void) {
 		}
 	}
 
-	if (strlen(post_buff) != 1 || post_buff[0] != '\n') {
-		fprintf(stdout, "%s", post_buff);
-		fflush(stdout);
+	// don't echo lines that are just a newline
+	if (post_len - line_start == 1 && post_buff[line_start] == '\n') {
+		post_len = line_start;
 	}
-	free(post_buff);
-
+	ics_scanner__delete_buffer(scan_state);
+}
 
-	return;
+/* Parse everything the reader has queued, then echo it all at once */
+void parse_ics_buffer(void) {
+	size_t len;
+	char *line = line_queue_wait(ics_lines, &len);
+	while (line) {
+		parse_ics_line(line, len);
+		line_queue_release(ics_lines);
+		// long bursts still show up on the console as they go
+		if (post_len >= ICS_CONSOLE_FLUSH_SIZE) {
+			flush_ics_console();
+		}
+		line = line_queue_try(ics_lines, &len);
+	}
+	flush_ics_console();
 }
 
 void *read_message_function(void *ptr) {
 	int *socket = (int *) (ptr);
 
-	while (!read_write_ics_fd(STDIN_FILENO, ics_data_pipe[1], *socket)) {
-		usleep(10000);
-	}
+	ics_io_loop(STDIN_FILENO, *socket, ics_lines);
 
 	fprintf(stdout, "[read ics thread] - Closing ICS reader\n");
 	return 0;
 }
 
+/* Stands in for the reader thread: plays the recording through the
+ * parser and tells how fast it went once everything was parsed */
+void *replay_ics_function(void *ptr) {
+	struct timeval start, end, elapsed;
+
+	gettimeofday(&start, NULL);
+	long chunks = ics_replay(ics_replay_path, ics_lines, replay_fast);
+	if (chunks < 0) {
+		return 0;
+	}
+	while (!line_queue_drained(ics_lines)) {
+		usleep(1000);
+	}
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &elapsed);
+
+	double secs = elapsed.tv_sec + elapsed.tv_usec / 1e6;
+	unsigned long count = line_queue_committed(ics_lines);
+	fprintf(stdout, "[replay ics thread] - Replayed %ld chunks, %lu lines in %.3fs: %.0f lines/s\n",
+	        chunks, count, secs, secs > 0 ? count / secs : 0);
+	return 0;
+}
+
 void *parse_ics_function(void *ptr) {
 
 	while (is_running_flag()) {
@@ -1691,15 +2155,24 @@ int init_ics() {
 		return 1;
 	}
 	fprintf(stdout, "Connected to ICS server.\n");
-	if (pipe(ics_data_pipe)) {
-		perror("Pipe creation failed");
-		return 1;
+	if (*ics_record_path && !ics_record_open(ics_record_path)) {
+		fprintf(stdout, "Recording ICS traffic to %s\n", ics_record_path);
 	}
+	ics_lines = line_queue_new();
 	pthread_create(&ics_reader_thread, NULL, read_message_function, (void*)(&ics_fd));
 	pthread_create(&ics_buff_parser_thread, NULL, parse_ics_function, (void*)(&ics_fd));
 	return 0;
 }
 
+int init_ics_replay() {
+	fprintf(stdout, "Replaying ICS traffic from %s%s\n", ics_replay_path, replay_fast ? " at full speed" : "");
+	ics_replaying = true;
+	ics_lines = line_queue_new();
+	pthread_create(&ics_reader_thread, NULL, replay_ics_function, NULL);
+	pthread_create(&ics_buff_parser_thread, NULL, parse_ics_function, NULL);
+	return 0;
+}
+
 void cleanup_ics() {
 	if (ics_reader_thread != NULL) {
 		pthread_cancel(ics_reader_thread);
@@ -1709,6 +2182,12 @@ void cleanup_ics() {
 		pthread_cancel(ics_buff_parser_thread);
 		pthread_join(ics_buff_parser_thread, NULL);
 	}
+	if (ics_lines != NULL) {
+		line_queue_free(ics_lines);
+		ics_lines = NULL;
+	}
+	remove_all_ics_games();
+	ics_record_close();
 	if (echo_is_off) {
 		toggle_echo(1);
 	}
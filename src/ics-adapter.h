@@ -7,6 +7,7 @@ extern bool invalid_password;
 extern int ics_fd;
 
 int init_ics(void);
+int init_ics_replay(void);
 void cleanup_ics(void);
 bool check_board12_game_consistency(void);
 
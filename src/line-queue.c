@@ -0,0 +1,160 @@
+/*
+ * line-queue.c
+ *
+ * Single producer, single consumer queue of text lines. The network thread
+ * fills lines in place and the parser gets them back whole, without a
+ * mutex on either side. Two semaphores count the filled and the free slots
+ * so each side only sleeps when it has nothing to do.
+ *
+ * Slot buffers are reused from one lap to the next and every line is kept
+ * terminated by two NULs, so the consumer can hand it to flex's
+ * yy_scan_buffer() without copying it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <semaphore.h>
+
+#include "line-queue.h"
+
+// Two NULs for yy_scan_buffer()
+#define LINE_TERMINATOR_SIZE 2
+#define LINE_INITIAL_ALLOC 128
+
+typedef struct {
+	char *text;
+	size_t len;
+	size_t alloc;
+} line_slot;
+
+struct _line_queue {
+	line_slot slots[LINE_QUEUE_SIZE];
+	sem_t filled;
+	sem_t free;
+	// only touched by the producer
+	size_t tail;
+	bool open;
+	unsigned long committed;
+	// only touched by the consumer
+	size_t head;
+};
+
+line_queue *line_queue_new(void) {
+	line_queue *q = calloc(1, sizeof(line_queue));
+	if (!q) {
+		perror("Calloc failed!!");
+		exit(1);
+	}
+	sem_init(&q->filled, 0, 0);
+	sem_init(&q->free, 0, LINE_QUEUE_SIZE);
+	return q;
+}
+
+void line_queue_free(line_queue *q) {
+	int i;
+	for (i = 0; i < LINE_QUEUE_SIZE; i++) {
+		free(q->slots[i].text);
+	}
+	sem_destroy(&q->filled);
+	sem_destroy(&q->free);
+	free(q);
+}
+
+/* Room for len more bytes at the end of the line being filled. Opens a new
+ * line first if needed, waiting for the consumer while the queue is full */
+char *line_queue_reserve(line_queue *q, size_t len) {
+	line_slot *slot = &q->slots[q->tail];
+
+	if (!q->open) {
+		while (sem_wait(&q->free)) {
+			// interrupted, try again
+		}
+		q->open = true;
+		slot->len = 0;
+	}
+
+	size_t needed = slot->len + len + LINE_TERMINATOR_SIZE;
+	if (needed > slot->alloc) {
+		size_t new_alloc = slot->alloc ? slot->alloc : LINE_INITIAL_ALLOC;
+		while (new_alloc < needed) {
+			new_alloc *= 2;
+		}
+		char *temp = realloc(slot->text, new_alloc);
+		if (!temp) {
+			perror("Realloc failed!!");
+			exit(1);
+		}
+		slot->text = temp;
+		slot->alloc = new_alloc;
+	}
+	return slot->text + slot->len;
+}
+
+/* Account for len bytes written at the pointer given by line_queue_reserve() */
+void line_queue_advance(line_queue *q, size_t len) {
+	q->slots[q->tail].len += len;
+}
+
+/* What the line being filled holds so far, NULL if there is none */
+const char *line_queue_partial(line_queue *q, size_t *len) {
+	if (!q->open) {
+		return NULL;
+	}
+	*len = q->slots[q->tail].len;
+	return q->slots[q->tail].text;
+}
+
+/* Hand the line being filled over to the consumer */
+void line_queue_commit(line_queue *q) {
+	if (!q->open) {
+		return;
+	}
+	line_slot *slot = &q->slots[q->tail];
+	memset(slot->text + slot->len, 0, LINE_TERMINATOR_SIZE);
+	q->open = false;
+	q->tail = (q->tail + 1) & (LINE_QUEUE_SIZE - 1);
+	q->committed++;
+	sem_post(&q->filled);
+}
+
+/* How many lines were handed over so far */
+unsigned long line_queue_committed(line_queue *q) {
+	return q->committed;
+}
+
+/* True once the consumer has released every line handed over */
+bool line_queue_drained(line_queue *q) {
+	int free_slots;
+	sem_getvalue(&q->free, &free_slots);
+	return free_slots == LINE_QUEUE_SIZE;
+}
+
+void line_queue_push(line_queue *q, const char *line, size_t len) {
+	memcpy(line_queue_reserve(q, len), line, len);
+	line_queue_advance(q, len);
+	line_queue_commit(q);
+}
+
+/* Oldest line, waiting for one if the queue is empty. The text stays valid
+ * and may be modified until line_queue_release() */
+char *line_queue_wait(line_queue *q, size_t *len) {
+	while (sem_wait(&q->filled)) {
+		// interrupted, try again
+	}
+	*len = q->slots[q->head].len;
+	return q->slots[q->head].text;
+}
+
+/* Same as line_queue_wait() but returns NULL straight away when empty */
+char *line_queue_try(line_queue *q, size_t *len) {
+	if (sem_trywait(&q->filled)) {
+		return NULL;
+	}
+	*len = q->slots[q->head].len;
+	return q->slots[q->head].text;
+}
+
+void line_queue_release(line_queue *q) {
+	q->head = (q->head + 1) & (LINE_QUEUE_SIZE - 1);
+	sem_post(&q->free);
+}
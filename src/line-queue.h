@@ -0,0 +1,29 @@
+#ifndef __CAIRO_BOARD_LINE_QUEUE_H__
+#define __CAIRO_BOARD_LINE_QUEUE_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Lines in flight between the producer and the consumer, power of two
+#define LINE_QUEUE_SIZE 1024
+
+typedef struct _line_queue line_queue;
+
+line_queue *line_queue_new(void);
+void line_queue_free(line_queue *q);
+
+/* Producer side */
+char *line_queue_reserve(line_queue *q, size_t len);
+void line_queue_advance(line_queue *q, size_t len);
+const char *line_queue_partial(line_queue *q, size_t *len);
+void line_queue_commit(line_queue *q);
+void line_queue_push(line_queue *q, const char *line, size_t len);
+unsigned long line_queue_committed(line_queue *q);
+bool line_queue_drained(line_queue *q);
+
+/* Consumer side */
+char *line_queue_wait(line_queue *q, size_t *len);
+char *line_queue_try(line_queue *q, size_t *len);
+void line_queue_release(line_queue *q);
+
+#endif
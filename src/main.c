@@ -28,6 +28,8 @@
 #include "analysis_panel.h"
 #include "test.h"
 #include "ics-adapter.h"
+#include "sprite-cache.h"
+#include "export.h"
 
 /* check that C's multibyte output is supported for use with figurine characters */
 #ifndef __STDC_ISO_10646__
@@ -72,6 +74,8 @@ gboolean ics_mode = FALSE;
 bool guest_mode = false;
 
 gboolean use_fig = FALSE;
+gboolean image_layers_flag = FALSE;
+static gboolean draw_stats_flag = FALSE;
 gboolean show_last_move = FALSE;
 gboolean always_promote_to_queen = FALSE;
 gboolean highlight_moves = FALSE;
@@ -99,10 +103,22 @@ unsigned short default_ics_port = 5000;
 char file_to_load[PATH_MAX];
 unsigned int game_to_load = 1;
 unsigned int auto_play_delay = 1000;
+char export_path[PATH_MAX];
+int export_size = 0; // depends on what is exported
+int export_delay = EXPORT_FRAME_DELAY_MS;
+char thumbnails_dir[PATH_MAX];
+int thumb_ply = 0;
+int export_threads = 0;
+// Raw ICS traffic is saved to ics_record_path, or read back from ics_replay_path instead of the network
+char ics_record_path[PATH_MAX];
+char ics_replay_path[PATH_MAX];
+gboolean replay_fast = FALSE;
 
 bool ics_host_specified = false;
 bool ics_port_specified = false;
 bool load_file_specified = false;
+bool export_specified = false;
+bool thumbnails_specified = false;
 bool ics_handle1_specified = false;
 bool ics_handle2_specified = false;
 /* </Options variables> */
@@ -135,7 +151,28 @@ GtkWidget *label_frame_event_box;
 
 // moves list text box
 static GtkWidget *moves_list_view;
-static GtkTextBuffer *moves_list_buffer;
+static GtkListStore *moves_list_store;
+
+// One row per full move, the view only lays out the visible rows
+enum {
+	MOVES_NUMBER_COLUMN = 0,
+	MOVES_WHITE_COLUMN,
+	MOVES_BLACK_COLUMN,
+	MOVES_N_COLUMNS
+};
+
+// Plys currently shown in the moves list view, so that only a changed tail
+// has to be redrawn. Free text rows (results) may follow shown_rows
+typedef struct {
+	char san[SAN_MOVE_SIZE];
+	int row;
+	int colour;
+} shown_ply;
+
+static shown_ply *shown_plys = NULL;
+static int shown_count = 0;
+static int shown_allocated = 0;
+static int shown_rows = 0;
 static GtkWidget* scrolled_window;
 GtkWidget* moves_list_title_label;
 static GtkWidget* opening_code_label;
@@ -237,7 +274,6 @@ void send_to_ics(char*);
 void set_header_label(const char *w_name, const char *b_name, const char *w_rating, const char *b_rating);
 
 static void get_int_from_popup(void);
-static void spawn_mover(void);
 
 /************************ <MULTITHREAD STUFF> ******************************/
 static bool moveit_flag;
@@ -267,10 +303,24 @@ void cleanup_mutexes(void) {
 }
 
 char last_move[MOVE_BUFF_SIZE];
+// Squares of last_move when the ICS gave them, -1 otherwise
+static int last_move_squares[4] = {-1, -1, -1, -1};
+static int last_move_promo_type = -1;
 
 void set_last_move(char *move) {
 	pthread_mutex_lock(&mutex_last_move);
 	strncpy(last_move, move, MOVE_BUFF_SIZE);
+	last_move_squares[0] = -1;
+	pthread_mutex_unlock(&mutex_last_move);
+}
+
+/* Same as set_last_move() with the squares already known, which saves
+ * resolving the SAN */
+void set_last_move_squares(char *move, int squares[4], int promo_type) {
+	pthread_mutex_lock(&mutex_last_move);
+	strncpy(last_move, move, MOVE_BUFF_SIZE);
+	memcpy(last_move_squares, squares, sizeof(last_move_squares));
+	last_move_promo_type = promo_type;
 	pthread_mutex_unlock(&mutex_last_move);
 }
 
@@ -280,6 +330,13 @@ void get_last_move(char *data) {
 	pthread_mutex_unlock(&mutex_last_move);
 }
 
+static void get_last_move_squares(int squares[4], int *promo_type) {
+	pthread_mutex_lock(&mutex_last_move);
+	memcpy(squares, last_move_squares, sizeof(last_move_squares));
+	*promo_type = last_move_promo_type;
+	pthread_mutex_unlock(&mutex_last_move);
+}
+
 void get_last_move_xy(int *x, int *y) {
 	pthread_mutex_lock(&last_move_xy_lock);
 	*x = last_move_x;
@@ -457,16 +514,46 @@ void assign_surfaces() {
 	}
 }
 
+/* Average time spent in each draw path, to compare --image-layers
+ * against native layers */
+static void print_draw_stats(int path, gint64 elapsed) {
+	static const char *names[3] = { "full", "scaled", "cheap" };
+	static gint64 total[3];
+	static int count[3];
+	int i;
+
+	total[path] += elapsed;
+	count[path]++;
+	if ((count[0] + count[1] + count[2]) % 100) {
+		return;
+	}
+	printf("draw stats (%s layers):", image_layers_flag ? "image" : "native");
+	for (i = 0; i < 3; i++) {
+		printf(" %s %d x %.1fus", names[i], count[i], count[i] ? (double) total[i] / count[i] : 0.0);
+	}
+	printf("\n");
+}
+
 static gboolean on_board_draw(GtkWidget *pWidget, cairo_t *cdr) {
 	int wi = gtk_widget_get_allocated_width(pWidget);
 	int hi = gtk_widget_get_allocated_height(pWidget);
+	gint64 start = g_get_monotonic_time();
+	int path;
 
 	if (needs_update) {
 		draw_full_update(cdr, wi, hi);
+		path = 0;
 	} else if (needs_scale) {
 		draw_scaled(cdr, wi, hi);
+		path = 1;
 	} else {
 		draw_cheap_repaint(cdr, wi, hi);
+		path = 2;
+	}
+
+	if (draw_stats_flag) {
+		cairo_surface_flush(cairo_get_target(cdr));
+		print_draw_stats(path, g_get_monotonic_time() - start);
 	}
 
 	return TRUE;
@@ -847,7 +934,21 @@ int move_piece(chess_piece *piece, int col, int row, int check_legality, int mov
 
 		// handle special promotion move
 		// NOTE: no need to reset 50 counter as done already
-		if (was_promotion) {
+		if (was_promotion && game != main_game) {
+			// games off the board promote in place, the promotion state is main_game's
+			char promo_string[8];
+			memset(promo_string, 0, 8);
+			if (use_fig) {
+				sprintf(promo_string, "=%lc", type_to_unicode_char(colorise_type(game->promo_type, game->whose_turn)));
+			}
+			else {
+				sprintf(promo_string, "=%c", type_to_char(game->promo_type));
+			}
+			strcat(move_in_san, promo_string);
+			toggle_piece(game, piece);
+			piece->type = colorise_type(game->promo_type, piece->colour);
+			toggle_piece(game, piece);
+		} else if (was_promotion) {
 			to_promote = piece;
 			if (move_source == MANUAL_SOURCE || move_source == PRE_MOVE) {
 				if (!always_promote_to_queen) {
@@ -1181,6 +1282,9 @@ static gboolean on_configure_event(GtkWidget *pWidget, GdkEventConfigure *event)
 			}
 			needs_scale = 1;
 			de_scale_timer = g_timeout_add(100, de_scale, board);
+
+			// have the sprites ready when de_scale fires
+			sprite_cache_prefetch(theme_dir, last_alloc_wi / 8, last_alloc_hi / 8);
 		}
 
 		// Force app to repaint the whole board
@@ -1195,7 +1299,7 @@ char theme_dir[] = "themes/commons/";
 //char theme_dir[] = "themes/eyes/";
 //char theme_dir[] = "themes/fantasy/";
 
-static int load_piecesSvg() {
+int load_piecesSvg(void) {
 	int i;
 
 	// relative or absolute
@@ -1232,6 +1336,8 @@ static int load_piecesSvg() {
 		memset(file_path+prefix_len, 0, sizeof(file_path)-prefix_len);
 	}
 
+	sprite_cache_add_theme(theme_dir, piecesSvg);
+
 	return 0;
 }
 
@@ -1300,17 +1406,31 @@ static int init_pieces(chess_game *game) {
 	return 0;
 }
 
-static void reset_game(bool lock_threads) {
-	main_game->current_move_number = 1;
-	memset(main_game->moves_list, 0, strlen(main_game->moves_list));
-	main_game->moves_list[0] = '\0';
-	main_game->ply_num = 1;
-	init_zobrist_hash_history(main_game);
-	init_pieces(main_game);
+/* Back to the starting position, without touching any widget */
+void reset_position(chess_game *game) {
+	game->current_move_number = 1;
+	memset(game->moves_list, 0, strlen(game->moves_list));
+	game->moves_list[0] = '\0';
+	game->ply_num = 1;
+	init_zobrist_hash_history(game);
+	init_pieces(game);
+}
+
+/* Back to the initial position, keeping main_list */
+void reset_main_position(void) {
+	reset_position(main_game);
+}
+
+void reset_main_game(void) {
+	reset_main_position();
 	if (main_list != NULL) {
 		plys_list_free(main_list);
 	}
 	main_list = plys_list_new();
+}
+
+static void reset_game(bool lock_threads) {
+	reset_main_game();
 
 	if (lock_threads) {
 		gdk_threads_enter();
@@ -1322,12 +1442,6 @@ static void reset_game(bool lock_threads) {
 	}
 }
 
-static pthread_t move_event_processor_thread;
-
-static void spawn_mover(void) {
-	pthread_create(&move_event_processor_thread, NULL, process_moves, NULL);
-}
-
 void send_to_ics(char *s) {
 	if (ics_mode) {
 		size_t len = strlen(s);
@@ -1435,10 +1549,12 @@ int open_file(const char *name) {
 	return 0;
 }
 
-void load_game(const char* file_path, int game_num) {
+/* Parse game game_num of a PGN file into main_list, playing it on
+ * main_game. Doesn't touch any widget. Returns 0 on success */
+int parse_game_file(const char* file_path, int game_num) {
 
 	if (open_file(file_path)) {
-		return;
+		return 1;
 	}
 
 	int i = 0;
@@ -1471,13 +1587,17 @@ void load_game(const char* file_path, int game_num) {
 				i = san_scanner_lex();
 			}
 		}
+		// the result isn't a move, it ends the game
+		if (i == MATCHED_END_TOKEN) {
+			if (found_my_game) {
+				break;
+			}
+			continue;
+		}
 		if (i != -1) {
 			if (inside_tags) {
 				inside_tags = FALSE;
 				if (found_my_game) {
-					gdk_threads_enter();
-					set_header_label(main_game->white_name, main_game->black_name, main_game->white_rating, main_game->black_rating);
-					gdk_threads_leave();
 					if (main_list != NULL) {
 						plys_list_free(main_list);
 					}
@@ -1491,8 +1611,14 @@ void load_game(const char* file_path, int game_num) {
 				if (resolved) {
 					debug("move resolved to %c%d-%c%d\n", resolved_move[0]+'a', resolved_move[1]+1, resolved_move[2]+'a', resolved_move[3]+1);
 					char san[SAN_MOVE_SIZE];
-					move_piece(main_game->squares[resolved_move[0]][resolved_move[1]].piece, resolved_move[2], resolved_move[3], 0, AUTO_SOURCE_NO_ANIM, san, main_game, false);
-					plys_list_append_ply(main_list, ply_new(resolved_move[0], resolved_move[1], resolved_move[2], resolved_move[3], NULL, san));
+					chess_piece *piece = main_game->squares[resolved_move[0]][resolved_move[1]].piece;
+					move_piece(piece, resolved_move[2], resolved_move[3], 0, AUTO_SOURCE_NO_ANIM, san, main_game, false);
+					ply *new_ply = ply_new(resolved_move[0], resolved_move[1], resolved_move[2], resolved_move[3], NULL, san);
+					// keep the promotion piece so the game can be replayed
+					if (piece->type != type) {
+						new_ply->promo_type = piece->type % 6;
+					}
+					plys_list_append_ply(main_list, new_ply);
 					blacks_ply = ! blacks_ply;
 				}
 				else {
@@ -1503,20 +1629,182 @@ void load_game(const char* file_path, int game_num) {
 			}
 		}
 	}
-	if (!failed) {
-		debug("Successfully parsed game number '%d' in database '%s'\n", game_num, file_path);
-		refresh_moves_list_view(main_list);
-	}
-	else {
+	if (failed) {
 		fprintf(stderr, "Failed to load/parse game number '%d' in database '%s'\n", game_num, file_path);
+		return 1;
+	}
+	debug("Successfully parsed game number '%d' in database '%s'\n", game_num, file_path);
+	return 0;
+}
+
+void load_game(const char* file_path, int game_num) {
+	if (parse_game_file(file_path, game_num)) {
+		return;
+	}
+	gdk_threads_enter();
+	set_header_label(main_game->white_name, main_game->black_name, main_game->white_rating, main_game->black_rating);
+	gdk_threads_leave();
+	refresh_moves_list_view(main_list);
+}
+
+/* <Ply navigation> */
+static void take_snapshot(chess_game *game, position_snapshot *snap) {
+	int i, colour, side;
+
+	for (i = 0; i < 16; i++) {
+		chess_piece *w = &game->white_set[i];
+		chess_piece *b = &game->black_set[i];
+		snap->squares[i] = (unsigned char) (w->pos.column * 8 + w->pos.row);
+		snap->types[i] = (unsigned char) (w->type | (w->dead ? SNAPSHOT_DEAD : 0));
+		snap->squares[16 + i] = (unsigned char) (b->pos.column * 8 + b->pos.row);
+		snap->types[16 + i] = (unsigned char) (b->type | (b->dead ? SNAPSHOT_DEAD : 0));
+	}
+	snap->castle_state = 0;
+	for (colour = 0; colour < 2; colour++) {
+		for (side = 0; side < 2; side++) {
+			if (game->castle_state[colour][side]) {
+				snap->castle_state |= 1 << (colour * 2 + side);
+			}
+		}
+	}
+	snap->en_passant = 0;
+	for (i = 0; i < 8; i++) {
+		if (game->en_passant[i]) {
+			snap->en_passant |= 1 << i;
+		}
+	}
+	snap->whose_turn = (unsigned char) game->whose_turn;
+	snap->fifty_move_counter = (unsigned short) game->fifty_move_counter;
+	snap->current_move_number = (unsigned short) game->current_move_number;
+	snap->ply_num = (unsigned short) game->ply_num;
+	snap->current_hash = game->current_hash;
+	memcpy(snap->zobrist_hash_history, game->zobrist_hash_history, sizeof(snap->zobrist_hash_history));
+	snap->hash_history_index = game->hash_history_index;
+}
+
+static void restore_snapshot(chess_game *game, const position_snapshot *snap) {
+	int i, colour, side;
+
+	memset(game->squares, 0, sizeof(game->squares));
+	for (i = 0; i < 32; i++) {
+		chess_piece *piece = i < 16 ? &game->white_set[i] : &game->black_set[i - 16];
+		piece->type = snap->types[i] & ~SNAPSHOT_DEAD;
+		piece->dead = (snap->types[i] & SNAPSHOT_DEAD) != 0;
+		piece->pos.column = snap->squares[i] / 8;
+		piece->pos.row = snap->squares[i] % 8;
+		piece->surf = piece_surfaces[piece->type];
+		if (!piece->dead) {
+			game->squares[piece->pos.column][piece->pos.row].piece = piece;
+		}
+	}
+	for (colour = 0; colour < 2; colour++) {
+		for (side = 0; side < 2; side++) {
+			game->castle_state[colour][side] = (snap->castle_state >> (colour * 2 + side)) & 1;
+		}
+	}
+	for (i = 0; i < 8; i++) {
+		game->en_passant[i] = (snap->en_passant >> i) & 1;
+	}
+	game->whose_turn = snap->whose_turn;
+	game->fifty_move_counter = snap->fifty_move_counter;
+	game->current_move_number = snap->current_move_number;
+	game->ply_num = snap->ply_num;
+	game->current_hash = snap->current_hash;
+	memcpy(game->zobrist_hash_history, snap->zobrist_hash_history, sizeof(snap->zobrist_hash_history));
+	game->hash_history_index = snap->hash_history_index;
+}
+
+/* Keeps a snapshot of main_game if it is at the next snapshot ply */
+static void add_snapshot(plys_list *list, int ply_num) {
+	if (ply_num % SNAPSHOT_INTERVAL || ply_num / SNAPSHOT_INTERVAL != list->snapshots_count) {
+		return;
+	}
+	if (list->snapshots_count == list->snapshots_allocated) {
+		list->snapshots_allocated += 16;
+		list->snapshots = realloc(list->snapshots, list->snapshots_allocated * sizeof(position_snapshot));
+	}
+	take_snapshot(main_game, &list->snapshots[list->snapshots_count++]);
+}
+
+static int replay_ply(ply *p) {
+	chess_piece *piece = main_game->squares[p->old_col][p->old_row].piece;
+	if (piece == NULL) {
+		fprintf(stderr, "No piece to move for ply %d\n", p->ply_number);
+		return 1;
+	}
+	if (p->promo_type) {
+		main_game->promo_type = colorise_type(p->promo_type, main_game->whose_turn);
+	} else {
+		// plys made on the board only have their SAN
+		char *promo = strrchr(p->san_string, '=');
+		int promo_type = promo != NULL ? char_to_type(main_game->whose_turn, promo[1]) : -1;
+		main_game->promo_type = promo_type != -1 ? promo_type : colorise_type(W_QUEEN, main_game->whose_turn);
+	}
+	move_piece(piece, p->new_col, p->new_row, 0, AUTO_SOURCE_NO_ANIM, NULL, main_game, true);
+	return 0;
+}
+
+/* Replays the plys in list on main_game from the initial position up to
+ * ply_num, taking snapshots on the way */
+int replay_moves_list_from_scratch(plys_list *list, int ply_num) {
+	int i;
+
+	list->snapshots_count = 0;
+	reset_main_position();
+	add_snapshot(list, 0);
+	for (i = 0; i < ply_num; i++) {
+		if (replay_ply(list->plys[i])) {
+			return 1;
+		}
+		add_snapshot(list, i + 1);
+	}
+	return 0;
+}
+
+/* Makes main_game's SAN moves list, read for the ECO lookup, match the
+ * first ply_num plys of list */
+static void rebuild_san_moves_list(plys_list *list, int ply_num) {
+	int i;
+	int whose_turn = main_game->whose_turn;
+
+	memset(main_game->moves_list, 0, strlen(main_game->moves_list));
+	main_game->ply_num = 1;
+	for (i = 0; i < ply_num; i++) {
+		// append_san_move expects the turn to be swapped already
+		main_game->whose_turn = i % 2 ? WHITE : BLACK;
+		append_san_move(main_game, list->plys[i]->san_string);
 	}
+	main_game->whose_turn = whose_turn;
 }
 
-/* replays from scratch the plys in list on the passed squares and pieces.
- * NOTE: the passed squares will be reset */
-int replay_moves_list_from_scratch(plys_list *list, chess_square sq[8][8], chess_piece w_set[16], chess_piece b_set[16]) {
+/* Puts main_game at the position after ply_num plys of list, replaying at
+ * most SNAPSHOT_INTERVAL plys from the closest snapshot before it */
+int show_ply(plys_list *list, int ply_num) {
+	int i, from;
+
+	if (ply_num < 0 || ply_num > list->last_ply) {
+		return 1;
+	}
+
+	int k = MIN(ply_num / SNAPSHOT_INTERVAL, list->snapshots_count - 1);
+	if (k < 0) {
+		if (replay_moves_list_from_scratch(list, ply_num)) {
+			return 1;
+		}
+	} else {
+		restore_snapshot(main_game, &list->snapshots[k]);
+		for (from = k * SNAPSHOT_INTERVAL, i = from; i < ply_num; i++) {
+			if (replay_ply(list->plys[i])) {
+				return 1;
+			}
+			add_snapshot(list, i + 1);
+		}
+	}
+	rebuild_san_moves_list(list, ply_num);
+	list->viewed_ply = ply_num;
 	return 0;
 }
+/* </Ply navigation> */
 
 struct timeval wait_until_time;
 
@@ -1602,48 +1890,77 @@ gboolean print_main_clock(gpointer data) {
 }
 
 
+/* The piece the ICS moved, straight from the squares in its style 12 line.
+ * NULL when they are unknown or don't fit our position */
+static chess_piece *ics_move_piece(int squares[4], int promo_type) {
+	if (squares[0] == -1) {
+		return NULL;
+	}
+	chess_piece *piece = main_game->squares[squares[0]][squares[1]].piece;
+	if (piece == NULL || piece->dead || piece->colour != (bool) main_game->whose_turn) {
+		debug("Verbose move doesn't fit the board, resolving SAN instead\n");
+		return NULL;
+	}
+	if (promo_type != -1) {
+		main_game->promo_type = promo_type;
+	}
+	return piece;
+}
+
+/* Fallback for when the ICS move came without usable squares */
+static chess_piece *resolve_last_move(char *lm, int resolved_move[4]) {
+	san_scanner__scan_string(lm);
+	if (san_scanner_lex() == -1) {
+		fprintf(stderr, "san_scanner_lex returned -1 while scanning last move '%s'\n", lm);
+		return NULL;
+	}
+	char type_char = type_to_char(type);
+	if (!type_char) {
+		debug("Raw Move %s\n", currentMoveString);
+	} else {
+		debug("Raw Move %c%s\n", type_char, currentMoveString);
+	}
+	if (!resolve_move(main_game, type, currentMoveString, resolved_move)) {
+		fprintf(stderr, "Could not resolve move %c%s\n", type_to_char(type), currentMoveString);
+		return NULL;
+	}
+	return main_game->squares[resolved_move[0]][resolved_move[1]].piece;
+}
+
 gboolean auto_play_one_ics_move(gpointer data) {
 	debug("Autoplay one ics move\n");
 	int resolved_move[4];
+	int promo_type;
 	char lm[MOVE_BUFF_SIZE];
 
 	get_last_move(lm);
-	san_scanner__scan_string(lm);
-
-	if (san_scanner_lex() != -1) {
-		playing = true;
-		char type_char = type_to_char(type);
-		if (!type_char) {
-			debug("Raw Move %s\n", currentMoveString);
-		} else {
-			debug("Raw Move %c%s\n", type_char, currentMoveString);
-		}
-		int resolved = resolve_move(main_game, type, currentMoveString, resolved_move);
-		if (resolved) {
-			debug("Move resolved to %c%d-%c%d\n", resolved_move[0] + 'a', resolved_move[1] + 1, resolved_move[2] + 'a', resolved_move[3] + 1);
-			auto_move(main_game->squares[resolved_move[0]][resolved_move[1]].piece, resolved_move[2], resolved_move[3], 0, AUTO_SOURCE, false);
-			check_board12_game_consistency();
-			int premove[4];
-			get_pre_move(premove);
-			if (premove[0] != -1) {
-				if (auto_move(main_game->squares[premove[0]][premove[1]].piece, premove[2], premove[3], 1, PRE_MOVE, false) > 0) {
-					debug("Pre-move was accepted\n");
-				} else {
-					debug("Pre-move was rejected\n");
-				}
-				cancel_pre_move(old_wi, old_hi, true);
-			}
-			return true;
+	get_last_move_squares(resolved_move, &promo_type);
+
+	chess_piece *piece = ics_move_piece(resolved_move, promo_type);
+	if (piece == NULL) {
+		piece = resolve_last_move(lm, resolved_move);
+	}
+	if (piece == NULL) {
+		// Reached EOF
+		playing = false;
+		return false;
+	}
+
+	playing = true;
+	debug("Move resolved to %c%d-%c%d\n", resolved_move[0] + 'a', resolved_move[1] + 1, resolved_move[2] + 'a', resolved_move[3] + 1);
+	auto_move(piece, resolved_move[2], resolved_move[3], 0, AUTO_SOURCE, false);
+	check_board12_game_consistency();
+	int premove[4];
+	get_pre_move(premove);
+	if (premove[0] != -1) {
+		if (auto_move(main_game->squares[premove[0]][premove[1]].piece, premove[2], premove[3], 1, PRE_MOVE, false) > 0) {
+			debug("Pre-move was accepted\n");
 		} else {
-			fprintf(stderr, "Could not resolve move %c%s\n", type_to_char(type), currentMoveString);
+			debug("Pre-move was rejected\n");
 		}
-	} else {
-		fprintf(stderr, "san_scanner_lex returned -1 while scanning last move '%s'\n", lm);
+		cancel_pre_move(old_wi, old_hi, true);
 	}
-
-	// Reached EOF
-	playing = false;
-	return false;
+	return true;
 }
 
 gboolean auto_play_one_crafty_move(gpointer data) {
@@ -1894,14 +2211,13 @@ gint cleanup(gpointer ignored) {
 
 	/* cancel threads and wait for all threads to exit */
 	debug("Cancelling all threads...\n");
-	pthread_cancel(move_event_processor_thread);
-	pthread_join(move_event_processor_thread, NULL);
 	if (ics_mode) {
 		cleanup_ics();
 	}
 
 	cleanup_uci();
 	cleanup_mutexes();
+	sprite_cache_cleanup();
 
 	debug("All threads terminated\n");
 
@@ -1922,6 +2238,7 @@ ply *ply_new(int oc, int or, int nc, int nr, chess_piece *taken, const char *san
 	new->old_row = or;
 	new->new_col = nc;
 	new->new_row = nr;
+	new->promo_type = 0;
 	new->piece_taken = taken;
 	strncpy(new->san_string, san, 15);
 	return new;
@@ -1948,6 +2265,10 @@ plys_list *plys_list_new(void) {
 	new->viewed_ply = 0;
 	new->plys_allocated = MOVES_LIST_ALLOC_PAGE_SIZE;
 
+	new->snapshots = NULL;
+	new->snapshots_count = 0;
+	new->snapshots_allocated = 0;
+
 	return new;
 }
 
@@ -1967,6 +2288,16 @@ void plys_list_grow(plys_list *list) {
 }
 
 void plys_list_append_ply(plys_list *list, ply *to_append) {
+	// a move made while looking at an earlier ply replaces what followed
+	while (list->last_ply > list->viewed_ply) {
+		list->last_ply--;
+		free(list->plys[list->last_ply]);
+		list->plys[list->last_ply] = NULL;
+	}
+	if (list->snapshots_count > 1 + list->last_ply / SNAPSHOT_INTERVAL) {
+		list->snapshots_count = 1 + list->last_ply / SNAPSHOT_INTERVAL;
+	}
+
 	if (list->last_ply >= list->plys_allocated - 1) {
 		plys_list_grow(list);
 	}
@@ -1975,6 +2306,7 @@ void plys_list_append_ply(plys_list *list, ply *to_append) {
 	to_append->ply_number = list->last_ply + 1;
 
 	list->plys[list->last_ply++] = to_append;
+	list->viewed_ply = list->last_ply;
 }
 
 void plys_list_print(plys_list *list) {
@@ -1993,40 +2325,11 @@ void plys_list_free(plys_list *to_destroy) {
 		i++;
 	}
 	free(to_destroy->plys);
+	free(to_destroy->snapshots);
 	free(to_destroy);
 }
 /* </Moves List data structures utilities> */
 
-/* Append text at the end of the moves_list buffer
- * NB: text must be NULL terminated*/
-void insert_text_moves_list_view(const gchar *text, bool should_lock_threads) {
-	if (should_lock_threads) {
-		gdk_threads_enter();
-	}
-	if (!GTK_IS_TEXT_VIEW(moves_list_view)) {
-		// Killed? tough!
-		return;
-	}
-
-	/* append the text at the end of the buffer */
-	GtkTextMark *end_mark = gtk_text_buffer_get_mark(moves_list_buffer, "end_bookmark");
-	if (!end_mark) {
-		fprintf(stderr, "Failed to get the mark at the end of the moves_list buffer!\n");
-		return;
-	}
-	GtkTextIter mark_it;
-	gtk_text_buffer_get_iter_at_mark(moves_list_buffer, &mark_it, end_mark);
-	gtk_text_buffer_insert(moves_list_buffer, &mark_it, text, -1);
-
-	/* scroll to bottom */
-	gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(moves_list_view), end_mark, .0, FALSE, .0, .0);
-
-	if (should_lock_threads) {
-		gdk_threads_leave();
-	}
-}
-
-
 /* maps white_pawn type and black_pawn type to <colour>_pawn type etc... */
 int get_type_colour(int tt) {
 	if (tt < B_KING) {
@@ -2052,113 +2355,278 @@ int colorise_type(int tt, int colour) {
 }
 
 
-/* delete contents of the moves list view and 
- * repopulate it with the passed plys_list */
-void refresh_moves_list_view(plys_list *list) {
+/* SAN of one ply as shown in the moves list, with figurines if enabled */
+static void format_ply_san(int colour, const char *san_move, char str[MOVE_TEXT_SIZE]) {
+	int tt = char_to_type(colour, san_move[0]);
 
-	int ply_colour;
-
-	char *str;
-	str = calloc(list->last_ply, 16*sizeof(char));
+	if (use_fig && tt != -1) {
+		snprintf(str, MOVE_TEXT_SIZE, "%lc%s", type_to_unicode_char(tt), san_move + 1);
+	} else {
+		snprintf(str, MOVE_TEXT_SIZE, "%s", san_move);
+	}
+	char *promo = strrchr(str, '=');
+	if (use_fig && promo != NULL) {
+		// promo handling figurine
+		int promo_type = char_to_type(colour, promo[1]);
+		if (promo_type != -1) {
+			sprintf(promo + 1, "%lc", type_to_unicode_char(promo_type));
+		}
+	}
+}
 
-	char str1[32];
-	memset(str1, 0, sizeof(str));
-	char str2[32];
-	memset(str2, 0, sizeof(str));
+/* Removes the rows from row onwards. Must be called with the GDK lock held */
+static void remove_moves_list_rows(int row) {
+	GtkTreeIter iter;
+	if (gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(moves_list_store), &iter, NULL, row)) {
+		while (gtk_list_store_remove(moves_list_store, &iter));
+	}
+}
 
-	reset_moves_list_view(TRUE);
+/* Keeps the first plys shown plys. Must be called with the GDK lock held */
+static void truncate_moves_list_view(int plys) {
+	GtkTreeIter iter;
 
-	int i = 0;
-	while (list->plys[i] != NULL) {
-		
-		ply *p = list->plys[i];
-		ply_colour = (p->ply_number + 1) % 2; // remember plys start at 1
+	if (plys >= shown_count) {
+		// just the free text rows
+		remove_moves_list_rows(shown_rows);
+		return;
+	}
+	shown_ply *first = &shown_plys[plys];
+	if (plys > 0 && shown_plys[plys - 1].row == first->row) {
+		// white's ply stays on that row
+		gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(moves_list_store), &iter, NULL, first->row);
+		gtk_list_store_set(moves_list_store, &iter, MOVES_BLACK_COLUMN, "", -1);
+		shown_rows = first->row + 1;
+	} else {
+		shown_rows = first->row;
+	}
+	remove_moves_list_rows(shown_rows);
+	shown_count = plys;
+}
 
-		char pchar = p->san_string[0];
-		int tt = char_to_type(main_game->whose_turn, pchar);
-		if (use_fig && tt != -1) {
-			tt = colorise_type(tt, ply_colour);
-			sprintf(str1, "%lc", type_to_unicode_char(tt));
-			strcat(str1, p->san_string+1);
-		}
-		else {
-			strcpy(str1, p->san_string);
-		}
+/* Adds one ply at the end of the view. Must be called with the GDK lock held */
+static void append_moves_list_ply(int move_number, int colour, const char *san_move) {
+	char str[MOVE_TEXT_SIZE];
+	char number[16];
+	GtkTreeIter iter;
 
-		/* insert move number if it is white's ply */
-		if (!ply_colour) {
-			sprintf(str2, "%d.\t", 1+p->ply_number/2);
-			strcat(str, str2);
-			strcat(str, str1);
-			strcat(str, "\t");
-		}
-		else {
-			/* append line feed if we're printing black's move */
-			sprintf(str2, "%s\n", str1);
-			strcat(str, str2);
-		}
+	format_ply_san(colour, san_move, str);
 
+	if (shown_count == shown_allocated) {
+		shown_allocated += MOVES_LIST_ALLOC_PAGE_SIZE;
+		shown_plys = realloc(shown_plys, shown_allocated * sizeof(shown_ply));
+	}
+	shown_ply *shown = &shown_plys[shown_count];
+	strncpy(shown->san, san_move, SAN_MOVE_SIZE - 1);
+	shown->san[SAN_MOVE_SIZE - 1] = '\0';
+	shown->colour = colour;
 
-		i++;
+	if (colour && shown_count > 0 && !shown_plys[shown_count - 1].colour) {
+		// black's reply goes next to white's move
+		shown->row = shown_rows - 1;
+		gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(moves_list_store), &iter, NULL, shown->row);
+		gtk_list_store_set(moves_list_store, &iter, MOVES_BLACK_COLUMN, str, -1);
+	} else {
+		shown->row = shown_rows++;
+		snprintf(number, sizeof(number), colour ? "%d..." : "%d.", move_number);
+		gtk_list_store_insert_with_values(moves_list_store, &iter, shown->row,
+		                                  MOVES_NUMBER_COLUMN, number,
+		                                  MOVES_WHITE_COLUMN, colour ? "" : str,
+		                                  MOVES_BLACK_COLUMN, colour ? str : "", -1);
 	}
-	insert_text_moves_list_view(str, true);
+	shown_count++;
+}
 
-	free(str);
+/* Must be called with the GDK lock held */
+static void scroll_moves_list_to_end(void) {
+	int rows = gtk_tree_model_iter_n_children(GTK_TREE_MODEL(moves_list_store), NULL);
+	if (rows == 0) {
+		return;
+	}
+	GtkTreePath *path = gtk_tree_path_new_from_indices(rows - 1, -1);
+	gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(moves_list_view), path, NULL, FALSE, .0, .0);
+	gtk_tree_path_free(path);
 }
 
+/* Bring the moves list view in line with the passed plys_list: the plys
+ * both have in common stay, the rest is replaced */
+void refresh_moves_list_view(plys_list *list) {
+	int i = 0;
 
-void insert_san_move(const char* san_move, bool should_lock_threads) {
+	gdk_threads_enter();
+	if (!GTK_IS_TREE_VIEW(moves_list_view)) {
+		gdk_threads_leave();
+		return;
+	}
 
-	append_san_move(main_game, san_move);
+	while (i < shown_count && i < list->last_ply && !strcmp(shown_plys[i].san, list->plys[i]->san_string)) {
+		i++;
+	}
+	if (i == shown_count && i == list->last_ply) {
+		gdk_threads_leave();
+		return;
+	}
 
-	char str[32];
-	memset(str, 0, sizeof(str));
-	char buf_str[16];
-	memset(buf_str, 0, sizeof(buf_str));
+	truncate_moves_list_view(i);
 
-	char pchar = san_move[0];
-	int tt = char_to_type(main_game->whose_turn, pchar);
-	if (use_fig && tt != -1) {
-		// char_to_type() will return opposite colour because we swapped whose_turn already
-		tt = colorise_type(tt, !main_game->whose_turn);
-		sprintf(buf_str, "%lc", type_to_unicode_char(tt));
-		strcat(buf_str, san_move + 1);
-	} else {
-		strcpy(buf_str, san_move);
+	// no point in having the view follow every single row of a long game
+	bool detach = list->last_ply - i > MOVES_LIST_ALLOC_PAGE_SIZE / 4;
+	if (detach) {
+		gtk_tree_view_set_model(GTK_TREE_VIEW(moves_list_view), NULL);
 	}
-	char *promo = strrchr(san_move, '=');
-	if (use_fig && promo != NULL) {
-		// promo handling figurine
-		int promo_type = char_to_type(!main_game->whose_turn, promo[1]);
-		sprintf(promo + 1, "%lc", type_to_unicode_char(promo_type));
+	for (; i < list->last_ply; i++) {
+		ply *p = list->plys[i];
+		int ply_colour = (p->ply_number + 1) % 2; // remember plys start at 1
+		append_moves_list_ply(1 + p->ply_number / 2, ply_colour, p->san_string);
+	}
+	if (detach) {
+		gtk_tree_view_set_model(GTK_TREE_VIEW(moves_list_view), GTK_TREE_MODEL(moves_list_store));
 	}
+	scroll_moves_list_to_end();
+
+	gdk_threads_leave();
+}
 
-	/* insert move number if it *was* white's ply */
-	if (main_game->whose_turn) {
-		sprintf(str, "%d.\t", main_game->current_move_number);
-		strcat(str, buf_str);
-		strcat(str, "\t");
+/* Append a line of free text, such as a result, after the moves */
+void insert_text_moves_list_view(const gchar *text, bool should_lock_threads) {
+	if (should_lock_threads) {
+		gdk_threads_enter();
 	}
-	else {
-		/* append line feed if we're printing black's move */
-		sprintf(str, "%s\n", buf_str);
+	if (!GTK_IS_TREE_VIEW(moves_list_view)) {
+		// Killed? tough!
+		if (should_lock_threads) {
+			gdk_threads_leave();
+		}
+		return;
 	}
 
-	insert_text_moves_list_view(str, should_lock_threads);
+	gchar *stripped = g_strstrip(g_strdup(text));
+	gtk_list_store_insert_with_values(moves_list_store, NULL, -1, MOVES_WHITE_COLUMN, stripped, -1);
+	g_free(stripped);
+	scroll_moves_list_to_end();
 
+	if (should_lock_threads) {
+		gdk_threads_leave();
+	}
 }
 
-/* deletes the contents of the buffer associated with the moves list view */
+void insert_san_move(const char* san_move, bool should_lock_threads) {
+
+	append_san_move(main_game, san_move);
+
+	if (should_lock_threads) {
+		gdk_threads_enter();
+	}
+	if (GTK_IS_TREE_VIEW(moves_list_view)) {
+		// moves go before any free text, and replace the ones after the viewed ply
+		if (main_list != NULL && main_list->viewed_ply < main_list->last_ply) {
+			truncate_moves_list_view(main_list->viewed_ply);
+		} else {
+			truncate_moves_list_view(shown_count);
+		}
+		// whose_turn was swapped already
+		append_moves_list_ply(main_game->current_move_number, !main_game->whose_turn, san_move);
+		scroll_moves_list_to_end();
+	}
+	if (should_lock_threads) {
+		gdk_threads_leave();
+	}
+
+}
+
+/* deletes the contents of the moves list view */
 void reset_moves_list_view(gboolean should_lock_threads) {
 	if (should_lock_threads) {
 		gdk_threads_enter();
 	}
-	gtk_text_buffer_set_text(moves_list_buffer, "", -1);
+	gtk_list_store_clear(moves_list_store);
+	shown_count = 0;
+	shown_rows = 0;
 	if (should_lock_threads) {
 		gdk_threads_leave();
 	}
 }
 
+/* Highlights the row of the viewed ply. Must be called with the GDK lock held */
+static void select_moves_list_ply(int ply_num) {
+	GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(moves_list_view));
+	if (ply_num <= 0 || ply_num > shown_count) {
+		gtk_tree_selection_unselect_all(selection);
+		return;
+	}
+	GtkTreePath *path = gtk_tree_path_new_from_indices(shown_plys[ply_num - 1].row, -1);
+	gtk_tree_selection_select_path(selection, path);
+	gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(moves_list_view), path, NULL, FALSE, .0, .0);
+	gtk_tree_path_free(path);
+}
+
+/* Shows the position after ply_num plys of main_list on the board. Only
+ * outside of a game, moves keep coming in during one */
+static void navigate_to_ply(int ply_num) {
+	int last_move[4];
+
+	if (game_started || main_list == NULL || ply_num == main_list->viewed_ply) {
+		return;
+	}
+	if (ply_num < 0 || ply_num > main_list->last_ply || show_ply(main_list, ply_num)) {
+		return;
+	}
+
+	if (ply_num > 0) {
+		ply *p = main_list->plys[ply_num - 1];
+		last_move[0] = p->old_col;
+		last_move[1] = p->old_row;
+		last_move[2] = p->new_col;
+		last_move[3] = p->new_row;
+	}
+	show_position(ply_num > 0 ? last_move : NULL, old_wi, old_hi);
+	select_moves_list_ply(ply_num);
+	update_eco_tag(false);
+}
+
+static void on_goto_first(GtkWidget *button, gpointer data) {
+	navigate_to_ply(0);
+}
+
+static void on_go_back(GtkWidget *button, gpointer data) {
+	if (main_list != NULL) {
+		navigate_to_ply(main_list->viewed_ply - 1);
+	}
+}
+
+static void on_go_forward(GtkWidget *button, gpointer data) {
+	if (main_list != NULL) {
+		navigate_to_ply(main_list->viewed_ply + 1);
+	}
+}
+
+static void on_goto_last(GtkWidget *button, gpointer data) {
+	if (main_list != NULL) {
+		navigate_to_ply(main_list->last_ply);
+	}
+}
+
+/* Clicking a move shows the position after it, the move number stands
+ * for the first move of the row */
+static void on_moves_list_row_activated(GtkTreeView *view, GtkTreePath *path, GtkTreeViewColumn *column, gpointer data) {
+	int row = gtk_tree_path_get_indices(path)[0];
+	int colour = column == gtk_tree_view_get_column(view, MOVES_BLACK_COLUMN);
+	int i, found = -1;
+
+	// a row holds plys 2 * row - 1 to 2 * row + 1 at most
+	for (i = MAX(0, 2 * row - 1); i < MIN(shown_count, 2 * row + 2); i++) {
+		if (shown_plys[i].row != row) {
+			continue;
+		}
+		if (found < 0 || shown_plys[i].colour == colour) {
+			found = i;
+		}
+	}
+	if (found >= 0) {
+		navigate_to_ply(found + 1);
+	}
+}
+
 GHashTable *eco_full;
 
 #define ECO_LINE_MAX 256
@@ -2230,6 +2698,49 @@ static gboolean spawn_uci_engine_idle(gpointer data) {
 	return FALSE;
 }
 
+/* The render benchmark brings its own main, see render-bench.c */
+#ifndef RENDER_BENCH
+/* Export to PNG without opening a window: thumbnails of every game of
+ * the loaded file, the loaded game, or the initial position */
+static int run_export(void) {
+	int ret;
+
+	if (export_size == 0) {
+		export_size = thumbnails_specified ? THUMB_DEFAULT_SIZE : EXPORT_DEFAULT_SIZE;
+	}
+	if (export_size < 8) {
+		fprintf(stderr, "Invalid export size %d\n", export_size);
+		return 1;
+	}
+	if (thumbnails_specified && !load_file_specified) {
+		fprintf(stderr, "Thumbnails need a PGN file, see -load\n");
+		return 1;
+	}
+	if (export_threads <= 0) {
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		export_threads = cores > 0 ? (int) cores : 1;
+	}
+
+	sprite_cache_init();
+	load_piecesSvg();
+	main_game = game_new();
+	reset_main_game();
+
+	if (thumbnails_specified) {
+		ret = export_thumbnails(file_to_load, thumbnails_dir, export_size, thumb_ply, export_threads);
+	} else if (load_file_specified) {
+		if (parse_game_file(file_to_load, game_to_load)) {
+			return 1;
+		}
+		ret = export_game(main_list, export_path, export_size, export_delay);
+	} else {
+		ret = export_position_png(export_path, export_size);
+	}
+
+	sprite_cache_cleanup();
+	return ret;
+}
+
 int main (int argc, char **argv) {
 
 	int c;
@@ -2253,6 +2764,17 @@ int main (int argc, char **argv) {
 			{"load",       required_argument, 0,                   LOAD_FILE_ARG},
 			{"gamenum",    required_argument, 0,                   LOAD_GAME_NUM_ARG},
 			{"delay",      required_argument, 0,                   AUTO_PLAY_DELAY_ARG},
+			{"image-layers", no_argument,     &image_layers_flag,  TRUE},
+			{"draw-stats", no_argument,       &draw_stats_flag,    TRUE},
+			{"export",     required_argument, 0,                   EXPORT_ARG},
+			{"export-size", required_argument, 0,                  EXPORT_SIZE_ARG},
+			{"export-delay", required_argument, 0,                 EXPORT_DELAY_ARG},
+			{"thumbnails", required_argument, 0,                   THUMBNAILS_ARG},
+			{"thumb-ply",  required_argument, 0,                   THUMB_PLY_ARG},
+			{"threads",    required_argument, 0,                   THREADS_ARG},
+			{"ics-record", required_argument, 0,                   ICS_RECORD_ARG},
+			{"ics-replay", required_argument, 0,                   ICS_REPLAY_ARG},
+			{"replay-fast", no_argument,      &replay_fast,        TRUE},
 			{0,            0,                 0,                   0}
 	};
 
@@ -2314,6 +2836,34 @@ int main (int argc, char **argv) {
 			case AUTO_PLAY_DELAY_ARG:
 				auto_play_delay = atoi(optarg);
 				break;
+			case EXPORT_ARG:
+				export_specified = true;
+				strncpy(export_path, optarg, sizeof(export_path) - 1);
+				break;
+			case EXPORT_SIZE_ARG:
+				export_size = atoi(optarg);
+				break;
+			case EXPORT_DELAY_ARG:
+				export_delay = atoi(optarg);
+				break;
+			case THUMBNAILS_ARG:
+				thumbnails_specified = true;
+				strncpy(thumbnails_dir, optarg, sizeof(thumbnails_dir) - 1);
+				break;
+			case THUMB_PLY_ARG:
+				thumb_ply = atoi(optarg);
+				break;
+			case THREADS_ARG:
+				export_threads = atoi(optarg);
+				break;
+			case ICS_RECORD_ARG:
+				strncpy(ics_record_path, optarg, sizeof(ics_record_path) - 1);
+				break;
+			case ICS_REPLAY_ARG:
+				// behave as in ICS mode, fed from the recording
+				ics_mode = TRUE;
+				strncpy(ics_replay_path, optarg, sizeof(ics_replay_path) - 1);
+				break;
 
 			default:
 				break;
@@ -2396,16 +2946,20 @@ int main (int argc, char **argv) {
 	/* initialise random numbers for Zobrist hashing */
 	init_zobrist_keys();
 
-	init_clock_colours();
-
 	init_anims_map();
 
+	// Exporting needs no display, don't bring up GTK at all
+	if (export_specified || thumbnails_specified) {
+		return run_export();
+	}
+
 	/* Initilialise threading stuff */
 	gdk_threads_init();
 	gdk_threads_enter();
 
 	gtk_init(&argc, &argv);
 
+	sprite_cache_init();
 	load_piecesSvg();
 
 	main_game = game_new();
@@ -2432,12 +2986,12 @@ int main (int argc, char **argv) {
 	GtkWidget *split_pane;
 	split_pane = gtk_paned_new(GTK_ORIENTATION_HORIZONTAL);
 
-	/* moves list text view widget */
-	moves_list_view = gtk_text_view_new();
-	gtk_text_view_set_editable(GTK_TEXT_VIEW(moves_list_view), FALSE);
-	gtk_text_view_set_cursor_visible(GTK_TEXT_VIEW(moves_list_view), FALSE);
-
-	moves_list_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW (moves_list_view));
+	/* moves list view, one row per move */
+	moves_list_store = gtk_list_store_new(MOVES_N_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+	moves_list_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(moves_list_store));
+	g_object_unref(moves_list_store);
+	gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(moves_list_view), FALSE);
+	g_object_set(moves_list_view, "can-focus", FALSE, NULL);
 
 	PangoFontDescription *desc;
 	desc = pango_font_description_from_string("Sans 12");
@@ -2451,10 +3005,19 @@ int main (int argc, char **argv) {
 	g_object_unref(playout);
 	san_char_width /= strlen(san_chars);
 
-	/* set tab stop */
-	PangoTabArray* tabarray = pango_tab_array_new_with_positions(2, 0, PANGO_TAB_LEFT, 6 * san_char_width, PANGO_TAB_LEFT, 15 * san_char_width);
-	gtk_text_view_set_tabs(GTK_TEXT_VIEW(moves_list_view), tabarray);
-	pango_tab_array_free(tabarray);
+	/* fixed column widths and row heights, so that only visible rows are ever measured */
+	const int column_chars[MOVES_N_COLUMNS] = { 6, 9, 9 };
+	int col;
+	for (col = 0; col < MOVES_N_COLUMNS; col++) {
+		GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+		GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes("", renderer, "text", col, NULL);
+		gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+		gtk_tree_view_column_set_fixed_width(column, PANGO_PIXELS(column_chars[col] * san_char_width));
+		gtk_tree_view_append_column(GTK_TREE_VIEW(moves_list_view), column);
+	}
+	gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(moves_list_view), TRUE);
+	gtk_tree_view_set_activate_on_single_click(GTK_TREE_VIEW(moves_list_view), TRUE);
+	g_signal_connect(moves_list_view, "row-activated", G_CALLBACK(on_moves_list_row_activated), NULL);
 
 	/* Title label for moves list viewer */
 	moves_list_title_label = gtk_label_new("\nCairo-Board\n");
@@ -2501,6 +3064,11 @@ int main (int argc, char **argv) {
 	gtk_button_set_image(GTK_BUTTON(go_forward_button),
 	                     (gtk_image_new_from_stock(GTK_STOCK_MEDIA_FORWARD, GTK_ICON_SIZE_SMALL_TOOLBAR)));
 
+	g_signal_connect(goto_first_button, "clicked", G_CALLBACK(on_goto_first), NULL);
+	g_signal_connect(go_back_button, "clicked", G_CALLBACK(on_go_back), NULL);
+	g_signal_connect(go_forward_button, "clicked", G_CALLBACK(on_go_forward), NULL);
+	g_signal_connect(goto_last_button, "clicked", G_CALLBACK(on_goto_last), NULL);
+
 	GtkWidget *controls_h_box = gtk_hbox_new(TRUE, 0);
 	gtk_box_pack_start(GTK_BOX(controls_h_box), goto_first_button, TRUE, TRUE, 0);
 	gtk_box_pack_start(GTK_BOX(controls_h_box), go_back_button, TRUE, TRUE, 0);
@@ -2513,17 +3081,6 @@ int main (int argc, char **argv) {
 	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_ALWAYS);
 	gtk_container_add(GTK_CONTAINER(scrolled_window), moves_list_view);
 
-	/* right gravity */
-	GtkTextIter start_bozo, end_iter;
-	gtk_text_buffer_get_bounds(moves_list_buffer, &start_bozo, &end_iter);
-
-	/* create the end mark */
-	gtk_text_buffer_create_mark(moves_list_buffer, "end_bookmark", &end_iter, 0);
-
-	gtk_text_buffer_create_tag(moves_list_buffer, "underline", "underline", PANGO_UNDERLINE_SINGLE, NULL);
-	gtk_text_buffer_create_tag(moves_list_buffer, "center", "justification", GTK_JUSTIFY_CENTER, NULL);
-	gtk_text_buffer_create_tag(moves_list_buffer, "font10pt", "size-points", 10.0, NULL);
-
 	/* Opening code label */
 	opening_code_label = gtk_label_new("");
 	add_class(opening_code_label, "eco-label");
@@ -2670,15 +3227,15 @@ int main (int argc, char **argv) {
 		}
 	}
 
-	if (ics_mode) {
+	if (*ics_replay_path) {
+		init_ics_replay();
+	} else if (ics_mode) {
 		init_ics();
 	}
 
 	bool brainfish = false;
 	g_idle_add(spawn_uci_engine_idle, &brainfish);
 
-	spawn_mover();
-
 	///////////////////////
 //	test_random_animation();
 //	test_crazy_flip();
@@ -2723,6 +3280,4 @@ int main (int argc, char **argv) {
 
 	return 0;
 }
-
-
-
+#endif
@@ -8,17 +8,177 @@
 #include <sys/types.h>
 
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
 #include "ics-adapter.h"
+#include "line-queue.h"
+#include "netstuff.h"
 
 #define BSIZE 1024
+// Room codec() needs on top of the line itself
+#define CODEC_OVERHEAD 32
+// Past this something is badly wrong with the stream
+#define RING_MAX_SIZE (1 << 22)
+
+/* Growable ring buffer, alloc is always a power of two so indexes wrap
+ * with a mask. Consumed bytes are released by moving start forward */
+struct ring_buffer {
+	char *data;
+	size_t alloc;
+	size_t start;
+	size_t len;
+};
 
 static char *key = "Timestamp (FICS) v1.0 - programmed by Henrik Gram.";
 static char hello[100] = "TIMESTAMP|cairo-board programmed by Julbra from FICS|Running on Gentoo Linux|";
 
+// Encoded data waiting for the ICS socket to become writable
+static pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *out_buff = NULL;
+static size_t out_start = 0;
+static size_t out_len = 0;
+static size_t out_alloc = 0;
+// While above zero output is queued but neither flushed nor does it wake up
+// the I/O loop
+static int out_hold = 0;
+
+// Written to by any thread queueing output so the I/O loop wakes up
+static int wake_fd = -1;
+
+// Prompts come without a newline but still make a line of their own
+static const char *ics_prompts[] = { "fics% ", "login: ", "password: " };
+
+/* Raw ICS traffic as it was received, one chunk per read:
+ * "<seconds since the start>.<microseconds> <length>\n" then the bytes and a '\n' */
+static FILE *record_file = NULL;
+static struct timeval record_start;
+
+/* Make room for at least min_free more bytes, unwrapping the contents */
+static int ring_reserve(struct ring_buffer *rb, size_t min_free) {
+	if (rb->alloc - rb->len >= min_free) {
+		return 0;
+	}
+	size_t new_alloc = rb->alloc ? rb->alloc : BSIZE;
+	while (new_alloc - rb->len < min_free) {
+		new_alloc *= 2;
+	}
+	if (new_alloc > RING_MAX_SIZE) {
+		return -1;
+	}
+	char *temp = malloc(new_alloc);
+	if (!temp) {
+		perror("Malloc failed!!");
+		exit(1);
+	}
+	size_t first = rb->alloc - rb->start;
+	if (first >= rb->len) {
+		memcpy(temp, rb->data + rb->start, rb->len);
+	}
+	else {
+		memcpy(temp, rb->data + rb->start, first);
+		memcpy(temp + first, rb->data, rb->len - first);
+	}
+	free(rb->data);
+	rb->data = temp;
+	rb->alloc = new_alloc;
+	rb->start = 0;
+	return 0;
+}
+
+/* Read straight into the free space, which may be split in two by the wrap */
+static ssize_t ring_read(struct ring_buffer *rb, int fd) {
+	struct iovec iov[2];
+	int count = 1;
+	size_t mask = rb->alloc - 1;
+	size_t end = (rb->start + rb->len) & mask;
+	size_t space = rb->alloc - rb->len;
+
+	iov[0].iov_base = rb->data + end;
+	iov[0].iov_len = rb->alloc - end < space ? rb->alloc - end : space;
+	if (iov[0].iov_len < space) {
+		iov[1].iov_base = rb->data;
+		iov[1].iov_len = space - iov[0].iov_len;
+		count = 2;
+	}
+
+	ssize_t n = readv(fd, iov, count);
+	if (n > 0) {
+		rb->len += n;
+	}
+	return n;
+}
+
+static void ring_consume(struct ring_buffer *rb, size_t n) {
+	rb->len -= n;
+	rb->start = rb->len ? (rb->start + n) & (rb->alloc - 1) : 0;
+}
+
+/* Offset of the first c from the start of the data, -1 if there is none */
+static ssize_t ring_find(struct ring_buffer *rb, char c) {
+	size_t first = rb->alloc - rb->start;
+	if (first > rb->len) {
+		first = rb->len;
+	}
+	char *found = memchr(rb->data + rb->start, c, first);
+	if (found) {
+		return found - (rb->data + rb->start);
+	}
+	found = memchr(rb->data, c, rb->len - first);
+	if (found) {
+		return first + (found - rb->data);
+	}
+	return -1;
+}
+
+/* Split n bytes from offset into at most two contiguous pieces */
+static int ring_iov_at(struct ring_buffer *rb, size_t offset, size_t n, struct iovec iov[2]) {
+	size_t start = (rb->start + offset) & (rb->alloc - 1);
+	size_t first = rb->alloc - start;
+	iov[0].iov_base = rb->data + start;
+	if (first >= n) {
+		iov[0].iov_len = n;
+		return 1;
+	}
+	iov[0].iov_len = first;
+	iov[1].iov_base = rb->data;
+	iov[1].iov_len = n - first;
+	return 2;
+}
+
+static int ring_iov(struct ring_buffer *rb, size_t n, struct iovec iov[2]) {
+	return ring_iov_at(rb, 0, n, iov);
+}
+
+static void ring_copy(struct ring_buffer *rb, char *dst, size_t n) {
+	struct iovec iov[2];
+	int i, count = ring_iov(rb, n, iov);
+	for (i = 0; i < count; i++) {
+		memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+		dst += iov[i].iov_len;
+	}
+}
+
+/* Compare the first bytes with s, only as far as we have data */
+static bool ring_has_prefix(struct ring_buffer *rb, const char *s, size_t n) {
+	size_t i;
+	for (i = 0; i < n && i < rb->len; i++) {
+		if (rb->data[(rb->start + i) & (rb->alloc - 1)] != s[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
 // encode the passed string using fics timeseal's protocol
 static size_t codec(char *s, size_t l) {
 
@@ -94,9 +254,25 @@ int open_tcp(char *hostname, unsigned short uport) {
 		return -1;
 	}
 
+	// moves are tiny and latency matters, bursts are coalesced in the output queue instead
+	int nodelay = 1;
+	if (setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay))) {
+		perror("TCP_NODELAY");
+	}
+
 	i = codec(hello, strlen(hello));
 	write_to_fd(socket_fd, hello, i);
 
+	// from now on all writes go through ics_io_loop()
+	fcntl(socket_fd, F_SETFL, fcntl(socket_fd, F_GETFL) | O_NONBLOCK);
+	if (wake_fd < 0) {
+		wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (wake_fd < 0) {
+			perror(NULL);
+			return -1;
+		}
+	}
+
 	return socket_fd;
 }
 
@@ -104,158 +280,474 @@ void close_tcp(int fd) {
 	close(fd);
 }
 
-void send_to_fics(char *buff, size_t *rd) {
+/* Room at the end of the output queue for a line of len bytes once
+ * encoded, out_lock must be held */
+static char *reserve_encoded(size_t len) {
+	if (out_len + len + CODEC_OVERHEAD > out_alloc) {
+		// reclaim what was already sent before growing
+		if (out_start) {
+			memmove(out_buff, out_buff + out_start, out_len - out_start);
+			out_len -= out_start;
+			out_start = 0;
+		}
+		size_t new_alloc = out_alloc ? out_alloc : BSIZE;
+		while (out_len + len + CODEC_OVERHEAD > new_alloc) {
+			new_alloc *= 2;
+		}
+		if (new_alloc != out_alloc) {
+			char *temp = realloc(out_buff, new_alloc);
+			if (!temp) {
+				perror("Realloc failed!!");
+				exit(1);
+			}
+			out_buff = temp;
+			out_alloc = new_alloc;
+		}
+	}
+	return out_buff + out_len;
+}
+
+/* Encode one line into the output queue, out_lock must be held */
+static void queue_encoded(char *line, size_t len) {
+	char *dst = reserve_encoded(len);
+	memcpy(dst, line, len);
+	out_len += codec(dst, len);
+}
 
-	// static storage duration, no linkage
-	static int i = 0;
+static void wake_io_loop(void) {
+	uint64_t one = 1;
+	if (wake_fd > -1 && write(wake_fd, &one, sizeof(one)) == -1) {
+		perror(NULL);
+	}
+}
 
-	for (; i < *rd; i++) {
+/* Queue every complete line of buff for the ICS and keep the unterminated
+ * tail at the start of buff. Safe to call from any thread */
+void send_to_fics(char *buff, size_t *rd) {
+	size_t start = 0;
+	char *nl;
 
-		// search for '\n' character
-		if (buff[i] == '\n') {
-			char ffub[BSIZE+20];
-			size_t k;
+	pthread_mutex_lock(&out_lock);
+	while ((nl = memchr(buff + start, '\n', *rd - start)) != NULL) {
+		queue_encoded(buff + start, nl - (buff + start));
+		start = nl - buff + 1;
+	}
+	bool held = out_hold > 0;
+	pthread_mutex_unlock(&out_lock);
 
-			// copy passed buffer till '\n'
-			memcpy(ffub, buff, (size_t) i);
+	if (start) {
+		if (*rd > start) {
+			memmove(buff, buff + start, *rd - start);
+		}
+		*rd -= start;
+		if (!held) {
+			wake_io_loop();
+		}
+	}
+}
 
-			// encode string
-			k = codec(ffub, i);
+/* Keep what gets sent until release_fics_output() in the queue so a burst
+ * of commands goes out in one write. Calls nest */
+void hold_fics_output(void) {
+	pthread_mutex_lock(&out_lock);
+	out_hold++;
+	pthread_mutex_unlock(&out_lock);
+}
 
-			/* send encoded data to socket */
-			write_to_fd(ics_fd, ffub, k);
+void release_fics_output(void) {
+	pthread_mutex_lock(&out_lock);
+	bool wake = --out_hold == 0 && out_len > out_start;
+	pthread_mutex_unlock(&out_lock);
+	if (wake) {
+		wake_io_loop();
+	}
+}
 
-			/* fold back end of buffer to the beginning */
-			for(i++, k = 0; i < *rd; i++, k++) {
-				buff[k] = buff[i];
+/* Write as much queued output as the socket takes without blocking, or
+ * nothing while output is held. The queue is contiguous so this is a single
+ * send() unless the socket fills up */
+static int flush_to_fics(int ics_fd) {
+	int ret = 0;
+	int old_state;
+
+	// don't get cancelled while holding out_lock
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+	pthread_mutex_lock(&out_lock);
+	// the whole burst goes out on release_fics_output()
+	while (out_hold == 0 && out_start < out_len) {
+		ssize_t n = send(ics_fd, out_buff + out_start, out_len - out_start, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				perror(NULL);
+				ret = -1;
 			}
-			*rd = k;
-			i = -1;
+			break;
 		}
+		out_start += n;
+	}
+	if (out_start == out_len) {
+		out_start = out_len = 0;
+	}
+	pthread_mutex_unlock(&out_lock);
+	pthread_setcancelstate(old_state, NULL);
+
+	return ret;
+}
+
+static bool output_pending(void) {
+	pthread_mutex_lock(&out_lock);
+	bool pending = out_hold == 0 && out_len > out_start;
+	pthread_mutex_unlock(&out_lock);
+	return pending;
+}
 
+/* Split decoded text into lines for the parser, leaving out the NULs,
+ * carriage returns and bells that would only confuse flex */
+static void queue_ics_text(line_queue *lines, const char *s, size_t n) {
+	while (n > 0) {
+		const char *nl = memchr(s, '\n', n);
+		size_t piece = nl ? (size_t) (nl - s) + 1 : n;
+		char *dst = line_queue_reserve(lines, piece);
+		size_t i, k = 0;
+		for (i = 0; i < piece; i++) {
+			if (s[i] != 0 && s[i] != '\r' && s[i] != 0x7) {
+				dst[k++] = s[i];
+			}
+		}
+		line_queue_advance(lines, k);
+		if (nl) {
+			line_queue_commit(lines);
+		}
+		s += piece;
+		n -= piece;
 	}
 }
 
-/* decode encrypted buff and write it to output_fd */
-static void get_from_fics(int ics_fd, int output_fd, char *buff, size_t *rd) {
+/* Don't keep a prompt back waiting for the rest of its line */
+static void commit_prompt(line_queue *lines) {
+	size_t len, i;
+	const char *partial = line_queue_partial(lines, &len);
+	if (!partial) {
+		return;
+	}
+	for (i = 0; i < sizeof(ics_prompts) / sizeof(ics_prompts[0]); i++) {
+		if (len == strlen(ics_prompts[i]) && !memcmp(partial, ics_prompts[i], len)) {
+			line_queue_commit(lines);
+			return;
+		}
+	}
+}
 
-	size_t n, m;
+/* Pass decoded data on to the line queue in '\r' terminated pieces,
+ * answering timeseal pings on the way */
+static void get_from_fics(line_queue *lines, struct ring_buffer *rb) {
+	struct iovec iov[2];
+	int i;
 
-	while(*rd > 0) {
+	while (rb->len > 0) {
 
-		// write ack to fics
-		if (!strncmp(buff, "[G]\n\r", *rd < 5 ? *rd : 5)) {
-			if(*rd < 5) {
+		// queue ack to fics
+		if (ring_has_prefix(rb, "[G]\n\r", 5)) {
+			if (rb->len < 5) {
 				break;
 			}
-			else {
-				char reply[20] = "\x2""9";
-				n = codec(reply, 2);
-				write_to_fd(ics_fd, reply, n);
-				for(n = 5; n < *rd; n++) {
-					buff[n-5] = buff[n];
-				}
-				*rd -= 5;
-				continue;
-			}
+			char reply[] = "\x2""9";
+			pthread_mutex_lock(&out_lock);
+			queue_encoded(reply, 2);
+			pthread_mutex_unlock(&out_lock);
+			ring_consume(rb, 5);
+			continue;
 		}
 
-		// find '\r' in buff
-		for (n = 0; n < *rd && buff[n] != '\r'; n++);
+		// up to and including '\r', or everything we have
+		ssize_t found = ring_find(rb, '\r');
+		size_t n = found < 0 ? rb->len : (size_t) found + 1;
 
-		// n < *rd means we found \r
-		if (n < *rd) {
-			n++;
+		int count = ring_iov(rb, n, iov);
+		for (i = 0; i < count; i++) {
+			queue_ics_text(lines, iov[i].iov_base, iov[i].iov_len);
 		}
+		ring_consume(rb, n);
+	}
+	commit_prompt(lines);
+}
 
-		// write the decoded data to output_fd
-		write_to_fd(output_fd, buff, n);
+/* Returns 1 on end of input, -1 on error */
+static int read_input(int input_fd) {
+	static struct ring_buffer rb;
+	ssize_t found;
 
-		for (m = n; m < *rd; m++) {
-			buff[m - n] = buff[m];
+	if (ring_reserve(&rb, BSIZE)) {
+		fprintf(stderr, "Line too long?!\n");
+		return -1;
+	}
+	ssize_t i = ring_read(&rb, input_fd);
+	if (!i) {
+		return 1;
+	}
+	if (i < 0) {
+		if (errno == EINTR || errno == EAGAIN) {
+			return 0;
 		}
-		*rd -= n;
+		perror(NULL);
+		return -1;
+	}
+
+	pthread_mutex_lock(&out_lock);
+	while ((found = ring_find(&rb, '\n')) > -1) {
+		char *dst = reserve_encoded(found);
+		ring_copy(&rb, dst, found);
+		out_len += codec(dst, found);
+		ring_consume(&rb, found + 1);
 	}
+	pthread_mutex_unlock(&out_lock);
+	return 0;
 }
 
-// Please optimise this
-int read_write_ics_fd(int input_fd, int output_fd, int ics_fd) {
+int ics_record_open(const char *path) {
+	record_file = fopen(path, "w");
+	if (!record_file) {
+		perror(path);
+		return -1;
+	}
+	gettimeofday(&record_start, NULL);
+	return 0;
+}
 
-	int i;
+void ics_record_close(void) {
+	if (record_file) {
+		fclose(record_file);
+		record_file = NULL;
+	}
+}
 
-	/* read and write file descriptor sets */
-	fd_set r_fds;
-	fd_set w_fds;
+/* Append the n bytes read at offset in the ring to the recording */
+static void record_chunk(struct ring_buffer *rb, size_t offset, size_t n) {
+	struct iovec iov[2];
+	struct timeval now, elapsed;
+	int i, count;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, &record_start, &elapsed);
+	fprintf(record_file, "%ld.%06ld %zu\n", (long) elapsed.tv_sec, (long) elapsed.tv_usec, n);
+	count = ring_iov_at(rb, offset, n, iov);
+	for (i = 0; i < count; i++) {
+		fwrite(iov[i].iov_base, 1, iov[i].iov_len, record_file);
+	}
+	fputc('\n', record_file);
+}
 
-	/* reset our file descriptor sets */
-	FD_ZERO(&r_fds);
-	FD_ZERO(&w_fds);
+/* Returns 1 when the server closed the connection, -1 on error */
+static int read_ics(int ics_fd, line_queue *lines) {
+	static struct ring_buffer rb;
+	static size_t want = BSIZE;
 
-	/* add input_fd to the read fds */
-	FD_SET(input_fd, &r_fds);
+	if (ring_reserve(&rb, want)) {
+		fprintf(stderr, "Receive buffer full?!\n");
+		return -1;
+	}
+	size_t space = rb.alloc - rb.len;
+	size_t old_len = rb.len;
+	ssize_t i = ring_read(&rb, ics_fd);
+	if (!i) {
+		fprintf(stderr, "Connection closed\n");
+		return 1;
+	}
+	if (i < 0) {
+		if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+			return 0;
+		}
+		perror(NULL);
+		return -1;
+	}
 
-	/* add ics_fd to both read and write fds */
-	FD_SET(ics_fd, &r_fds);
-	FD_SET(ics_fd, &w_fds);
+	if (record_file) {
+		record_chunk(&rb, old_len, i);
+	}
 
-	/* check I/O status of our fds */
-	select(ics_fd+1, &r_fds, &w_fds, NULL, NULL);
+	// decode and hand over to the parser
+	get_from_fics(lines, &rb);
 
-	// we can read from stdin and write to ics
-	if (FD_ISSET(input_fd, &r_fds) && FD_ISSET(ics_fd, &w_fds)) {
-		static size_t w_rd = 0;
-		static char buff[BSIZE];
+	// filled it up, read bigger chunks while the burst lasts
+	if ((size_t) i == space && want < RING_MAX_SIZE / 2) {
+		want *= 2;
+	}
+	return 0;
+}
 
-		// read from input_fd
-		w_rd += i = read(input_fd, buff + w_rd, BSIZE - w_rd);
+static int watch_fd(int epoll_fd, int op, int fd, uint32_t events) {
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	return epoll_ctl(epoll_fd, op, fd, &ev);
+}
 
-		if (!i) {
-			fprintf(stderr, "Read 0 bytes?!\n");
-			return 1;
-		}
-		if (i < 0) {
+/* Blocks until the connection closes, reacting to ICS data as soon as it
+ * arrives and passing it on to lines. The socket is only watched for
+ * writability while output queued by send_to_fics() could not be written
+ * straight away */
+int ics_io_loop(int input_fd, int ics_fd, line_queue *lines) {
+	struct epoll_event events[3];
+	bool want_write = false;
+	int ret = 0;
+	int i, n;
+
+	int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0) {
+		perror(NULL);
+		return -1;
+	}
+
+	if (watch_fd(epoll_fd, EPOLL_CTL_ADD, ics_fd, EPOLLIN) || watch_fd(epoll_fd, EPOLL_CTL_ADD, wake_fd, EPOLLIN)) {
+		perror(NULL);
+		close(epoll_fd);
+		return -1;
+	}
+	// regular files and /dev/null can't be watched, just ignore them
+	if (input_fd > -1 && watch_fd(epoll_fd, EPOLL_CTL_ADD, input_fd, EPOLLIN)) {
+		input_fd = -1;
+	}
+
+	// whatever got queued before we started
+	ret = flush_to_fics(ics_fd);
+
+	while (!ret) {
+		n = epoll_wait(epoll_fd, events, 3, -1);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
 			perror(NULL);
-			return -1;
+			ret = -1;
+			break;
 		}
 
-		send_to_fics(buff, &w_rd);
-		if (w_rd == BSIZE) {
-			fprintf(stderr, "Line too long?!\n");
-			return -1;
+		for (i = 0; i < n && !ret; i++) {
+			int fd = events[i].data.fd;
+			if (fd == wake_fd) {
+				uint64_t count;
+				if (read(wake_fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+					perror(NULL);
+				}
+			}
+			else if (fd == input_fd) {
+				int r = read_input(input_fd);
+				if (r > 0) {
+					// stdin closed, keep talking to the ICS
+					epoll_ctl(epoll_fd, EPOLL_CTL_DEL, input_fd, NULL);
+					input_fd = -1;
+				}
+				else {
+					ret = r;
+				}
+			}
+			else if (fd == ics_fd) {
+				if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+					ret = read_ics(ics_fd, lines);
+				}
+			}
+		}
+
+		if (!ret && output_pending()) {
+			ret = flush_to_fics(ics_fd);
+		}
+		bool pending = !ret && output_pending();
+		if (pending != want_write) {
+			watch_fd(epoll_fd, EPOLL_CTL_MOD, ics_fd, pending ? EPOLLIN | EPOLLOUT : EPOLLIN);
+			want_write = pending;
 		}
 	}
 
-	// we can read from and write to ics
-	if (FD_ISSET(ics_fd, &r_fds) && FD_ISSET(ics_fd, &w_fds)) {
-		static int r_rd = 0;
-		static char buff[BSIZE];
+	close(epoll_fd);
+	return ret;
+}
+
+/* Nobody is listening during a replay, forget what the parser sent */
+static void drop_output(void) {
+	pthread_mutex_lock(&out_lock);
+	out_start = out_len = 0;
+	pthread_mutex_unlock(&out_lock);
+}
+
+/* Feed a recording made with ics_record_open() to lines the same way
+ * read_ics() would, either as fast as the parser takes it or with the
+ * original timing. Returns the number of chunks or -1 on error */
+long ics_replay(const char *path, line_queue *lines, bool max_speed) {
+	struct ring_buffer rb;
+	struct timeval start, now, due, wait;
+	long sec, usec;
+	size_t n;
+	long chunks = 0;
+
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	memset(&rb, 0, sizeof(rb));
+	gettimeofday(&start, NULL);
 
-		/* read from ics */
-		r_rd += i = read(ics_fd, buff, BSIZE - r_rd);
-		if (!i) {
-			fprintf(stderr, "Connection closed\n");
-			return 1;
+	while (fscanf(f, "%ld.%ld %zu", &sec, &usec, &n) == 3 && fgetc(f) == '\n') {
+		if (ring_reserve(&rb, n)) {
+			fprintf(stderr, "Chunk %ld of %s is too big\n", chunks, path);
+			break;
 		}
-		if (i < 0) {
-			perror(NULL);
-			return -1;
+		struct iovec iov[2];
+		int i, count = ring_iov_at(&rb, rb.len, n, iov);
+		for (i = 0; i < count; i++) {
+			if (fread(iov[i].iov_base, 1, iov[i].iov_len, f) != iov[i].iov_len) {
+				fprintf(stderr, "Recording %s is truncated\n", path);
+				n = 0;
+				break;
+			}
+		}
+		if (!n || fgetc(f) != '\n') {
+			break;
 		}
 
-		// decode and write to output
-		get_from_fics(ics_fd, output_fd, buff, &r_rd);
-		if (r_rd == BSIZE) {
-			fprintf(stderr, "Receive buffer full?!\n");
-			return -1;
+		if (!max_speed) {
+			struct timeval offset = { sec, usec };
+			timeradd(&start, &offset, &due);
+			gettimeofday(&now, NULL);
+			if (timercmp(&due, &now, >)) {
+				timersub(&due, &now, &wait);
+				usleep(wait.tv_sec * 1000000 + wait.tv_usec);
+			}
 		}
+
+		rb.len += n;
+		get_from_fics(lines, &rb);
+		drop_output();
+		chunks++;
 	}
+	// the last line may not have had its newline yet
+	line_queue_commit(lines);
 
-	return 0;
+	fclose(f);
+	free(rb.data);
+	return chunks;
+}
 
+static void *print_lines_function(void *ptr) {
+	line_queue *lines = ptr;
+	size_t len;
+	for (;;) {
+		char *line = line_queue_wait(lines, &len);
+		fwrite(line, 1, len, stdout);
+		fflush(stdout);
+		line_queue_release(lines);
+	}
+	return NULL;
 }
 
 int main_n(int argc, char **argv) {
 	char *hostname;
 	int port, ics_fd;
+	pthread_t printer;
 
 	if(argc == 3) {
 		hostname = argv[1];
@@ -274,8 +766,14 @@ int main_n(int argc, char **argv) {
 		return 1;
 	}
 
-	while(!read_write_ics_fd(STDIN_FILENO, STDOUT_FILENO, ics_fd));
+	line_queue *lines = line_queue_new();
+	pthread_create(&printer, NULL, print_lines_function, lines);
+	int ret = ics_io_loop(STDIN_FILENO, ics_fd, lines) < 0;
 
-	return 0;
+	// let the printer catch up before leaving
+	usleep(100000);
+	pthread_cancel(printer);
+	pthread_join(printer, NULL);
+	line_queue_free(lines);
+	return ret;
 }
-
@@ -2,10 +2,19 @@
 #ifndef __NET_STUFF_H
 #define __NET_STUFF_H
 
+#include <stddef.h>
+#include <stdbool.h>
+#include "line-queue.h"
+
 int open_tcp(char *hostname, unsigned short uport);
 void close_tcp(int fd);
-int read_write_ics_fd(int input_fd, int output_fd, int ics_fd);
-void send_to_fics(char *buff, int *rd);
+int ics_io_loop(int input_fd, int ics_fd, line_queue *lines);
+void send_to_fics(char *buff, size_t *rd);
+void hold_fics_output(void);
+void release_fics_output(void);
+int ics_record_open(const char *path);
+void ics_record_close(void);
+long ics_replay(const char *path, line_queue *lines, bool max_speed);
 
 #endif
 
@@ -0,0 +1,301 @@
+/*
+ * render-bench.c
+ *
+ * Replays a PGN game through the offscreen renderer and reports how long
+ * the move, full update and resize paths take at several board sizes.
+ * Frames can be dumped as PNG files for inspection.
+ *
+ * Usage: render-bench [-sizes 320,480,640,960] [-repeat N] [-gamenum N]
+ *                     [-png-dir DIR] file.pgn
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <limits.h>
+#include <gtk/gtk.h>
+
+#include "cairo-board.h"
+#include "chess-backend.h"
+#include "drawing-backend.h"
+#include "san_scanner.h"
+#include "sprite-cache.h"
+
+#define MAX_SIZES 16
+#define MAX_PLYS 1024
+
+#define SIZES_ARG   1
+#define REPEAT_ARG  2
+#define GAMENUM_ARG 3
+#define PNG_DIR_ARG 4
+
+struct bench_ply {
+	int move[4];
+	int promo_type; // as the SAN scanner left it, only used by promotions
+};
+
+static struct bench_ply plys[MAX_PLYS];
+static int plys_count = 0;
+
+static int parse_sizes(const char *arg, int sizes[MAX_SIZES]) {
+	int count = 0;
+	char *end;
+	while (*arg && count < MAX_SIZES) {
+		long size = strtol(arg, &end, 10);
+		if (end == arg || size < 8) {
+			return -1;
+		}
+		sizes[count++] = (int) size;
+		arg = (*end == ',') ? end + 1 : end;
+	}
+	return count;
+}
+
+/* Resolve all the moves of game game_num, leaving main_game at its end */
+static int read_game(const char *file_path, int game_num) {
+	FILE *f = fopen(file_path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Error opening file '%s'\n", file_path);
+		return 1;
+	}
+	san_scanner_in = f;
+	san_scanner_restart(san_scanner_in);
+
+	int i = 0;
+	int games_counter = 0;
+	bool inside_tags = false;
+	bool found_my_game = false;
+	int blacks_ply = 0;
+
+	while (i != SAN_EOF_TYPE) {
+		i = san_scanner_lex();
+		if (i == MATCHED_TAG) {
+			if (!inside_tags) {
+				if (found_my_game) {
+					break;
+				}
+				inside_tags = true;
+				games_counter++;
+				found_my_game = games_counter == game_num;
+			}
+			continue;
+		}
+		inside_tags = false;
+		if (!found_my_game || i != MATCHED_MOVE) {
+			if (found_my_game && i == MATCHED_END_TOKEN) {
+				break;
+			}
+			continue;
+		}
+
+		int resolved_move[4];
+		int t = colorise_type(type, blacks_ply);
+		if (!resolve_move(main_game, t, currentMoveString, resolved_move)) {
+			fprintf(stderr, "Could not resolve move %c%s\n", type_to_char(t), currentMoveString);
+			break;
+		}
+		if (plys_count == MAX_PLYS) {
+			fprintf(stderr, "Game too long, only the first %d plys are replayed\n", MAX_PLYS);
+			break;
+		}
+		memcpy(plys[plys_count].move, resolved_move, sizeof(resolved_move));
+		plys[plys_count++].promo_type = main_game->promo_type;
+		char san[SAN_MOVE_SIZE];
+		move_piece(main_game->squares[resolved_move[0]][resolved_move[1]].piece, resolved_move[2], resolved_move[3], 0,
+		           AUTO_SOURCE_NO_ANIM, san, main_game, true);
+		blacks_ply = !blacks_ply;
+	}
+	fclose(f);
+
+	if (plys_count == 0) {
+		fprintf(stderr, "No moves found for game %d in '%s'\n", game_num, file_path);
+		return 1;
+	}
+	return 0;
+}
+
+static void dump_png(cairo_surface_t *surface, const char *png_dir, int size, int ply) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/frame-%d-%04d.png", png_dir, size, ply);
+	if (cairo_surface_write_to_png(surface, path) != CAIRO_STATUS_SUCCESS) {
+		fprintf(stderr, "Failed to write '%s'\n", path);
+	}
+}
+
+/* Replay the game at one size, timing each move's frame */
+static void bench_moves(int size, const char *png_dir) {
+	int i;
+	gint64 start, elapsed;
+	gint64 total = 0;
+	gint64 worst = 0;
+	char san[SAN_MOVE_SIZE];
+
+	cairo_surface_t *frame = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+	cairo_t *cr = cairo_create(frame);
+
+	reset_main_game();
+	assign_surfaces();
+	render_position(cr, size, size);
+	if (png_dir) {
+		dump_png(frame, png_dir, size, 0);
+	}
+
+	for (i = 0; i < plys_count; i++) {
+		int *m = plys[i].move;
+		chess_piece *piece = main_game->squares[m[0]][m[1]].piece;
+
+		main_game->promo_type = plys[i].promo_type;
+		start = g_get_monotonic_time();
+		int move_result = move_piece(piece, m[2], m[3], 0, AUTO_SOURCE_NO_ANIM, san, main_game, true);
+		render_move(cr, piece, m[0], m[1], move_result, size, size);
+		cairo_surface_flush(frame);
+		elapsed = g_get_monotonic_time() - start;
+
+		total += elapsed;
+		if (elapsed > worst) {
+			worst = elapsed;
+		}
+		if (png_dir) {
+			dump_png(frame, png_dir, size, i + 1);
+		}
+	}
+
+	printf("%5dpx  move:   %4d frames, avg %8.1fus, max %8ldus\n", size, plys_count, (double) total / plys_count,
+	       (long) worst);
+
+	cairo_destroy(cr);
+	cairo_surface_destroy(frame);
+}
+
+/* Full rebuild of every layer at an unchanged size */
+static void bench_full_update(int size, int repeat) {
+	int i;
+	gint64 start = 0;
+
+	cairo_surface_t *frame = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+	cairo_t *cr = cairo_create(frame);
+
+	// first one brings the layers to this size
+	render_position(cr, size, size);
+
+	start = g_get_monotonic_time();
+	for (i = 0; i < repeat; i++) {
+		render_position(cr, size, size);
+	}
+	cairo_surface_flush(frame);
+	printf("%5dpx  full:   %4d frames, avg %8.1fus\n", size, repeat, (double) (g_get_monotonic_time() - start) / repeat);
+
+	cairo_destroy(cr);
+	cairo_surface_destroy(frame);
+}
+
+/* Size changes, the first round includes rasterising the sprites so this
+ * has to run before anything else touches the sprite cache */
+static void bench_resize(int sizes[], int sizes_count, int repeat) {
+	int i, j;
+	gint64 cold[MAX_SIZES];
+	gint64 warm[MAX_SIZES];
+
+	memset(warm, 0, sizeof(warm));
+
+	for (j = 0; j <= repeat; j++) {
+		for (i = 0; i < sizes_count; i++) {
+			cairo_surface_t *frame = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, sizes[i], sizes[i]);
+			cairo_t *cr = cairo_create(frame);
+			gint64 start = g_get_monotonic_time();
+			render_position(cr, sizes[i], sizes[i]);
+			cairo_surface_flush(frame);
+			gint64 elapsed = g_get_monotonic_time() - start;
+			if (j == 0) {
+				cold[i] = elapsed;
+			} else {
+				warm[i] += elapsed;
+			}
+			cairo_destroy(cr);
+			cairo_surface_destroy(frame);
+		}
+	}
+
+	for (i = 0; i < sizes_count; i++) {
+		printf("%5dpx  resize: cold %8ldus, warm avg %8.1fus\n", sizes[i], (long) cold[i],
+		       repeat ? (double) warm[i] / repeat : 0.0);
+	}
+}
+
+int main(int argc, char **argv) {
+	int c;
+	int sizes[MAX_SIZES] = { 320, 480, 640, 960 };
+	int sizes_count = 4;
+	int repeat = 20;
+	int game_num = 1;
+	char *png_dir = NULL;
+
+	static struct option long_options[] = {
+			{"sizes",      required_argument, 0,                   SIZES_ARG},
+			{"repeat",     required_argument, 0,                   REPEAT_ARG},
+			{"gamenum",    required_argument, 0,                   GAMENUM_ARG},
+			{"png-dir",    required_argument, 0,                   PNG_DIR_ARG},
+			{0,            0,                 0,                   0}
+	};
+
+	for (;;) {
+		int option_index = 0;
+		c = getopt_long_only(argc, argv, "", long_options, &option_index);
+		if (c == -1) {
+			break;
+		}
+		switch (c) {
+			case SIZES_ARG:
+				sizes_count = parse_sizes(optarg, sizes);
+				if (sizes_count <= 0) {
+					fprintf(stderr, "Invalid sizes '%s'\n", optarg);
+					return 1;
+				}
+				break;
+			case REPEAT_ARG:
+				repeat = atoi(optarg);
+				break;
+			case GAMENUM_ARG:
+				game_num = atoi(optarg);
+				break;
+			case PNG_DIR_ARG:
+				png_dir = optarg;
+				break;
+			default:
+				return 1;
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "Usage: %s [-sizes 320,480,...] [-repeat N] [-gamenum N] [-png-dir DIR] file.pgn\n", argv[0]);
+		return 1;
+	}
+	if (repeat < 1) {
+		repeat = 1;
+	}
+
+	init_zobrist_keys();
+	init_anims_map();
+	sprite_cache_init();
+	load_piecesSvg();
+
+	main_game = game_new();
+	reset_main_game();
+
+	if (read_game(argv[optind], game_num)) {
+		return 1;
+	}
+
+	bench_resize(sizes, sizes_count, repeat);
+
+	int i;
+	for (i = 0; i < sizes_count; i++) {
+		bench_moves(sizes[i], png_dir);
+		bench_full_update(sizes[i], repeat);
+	}
+
+	sprite_cache_cleanup();
+	game_free(main_game);
+	return 0;
+}
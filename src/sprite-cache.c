@@ -0,0 +1,384 @@
+/*
+ * sprite-cache.c
+ *
+ * LRU cache of pre-rasterised piece sprites, keyed by (theme, piece, pixel size).
+ * Sprites are rendered once through librsvg and then reused across resizes.
+ * A background thread renders the sprites for the size the board is being
+ * resized to, so that they are ready by the time the board is redrawn.
+ * Full sets are rasterised in parallel by a small pool of worker threads.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "sprite-cache.h"
+#include "cairo-board.h"
+
+#define THEME_NAME_SIZE 128
+#define MAX_THEMES 8
+
+typedef struct _sprite {
+	char theme[THEME_NAME_SIZE];
+	int type;
+	int width;
+	int height;
+	cairo_surface_t *surf;
+	struct _sprite *prev;
+	struct _sprite *next;
+} sprite;
+
+typedef struct _sprite_theme {
+	char name[THEME_NAME_SIZE];
+	RsvgHandle *handles[12];
+	// An RsvgHandle must not be rendered from two threads at once
+	pthread_mutex_t render_locks[12];
+	double svg_width;
+	double svg_height;
+} sprite_theme;
+
+// A full set of sprites being rendered by the pool
+typedef struct _render_batch {
+	const char *theme;
+	int width;
+	int height;
+	int next_type; // next piece to hand out
+	int pending; // pieces handed out but not finished yet
+	cairo_surface_t **sprites;
+} render_batch;
+
+static sprite_theme themes[MAX_THEMES];
+static int n_themes = 0;
+
+// Most recently used sprite first
+static sprite *lru_head = NULL;
+static sprite *lru_tail = NULL;
+static int n_sprites = 0;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Worker pool, one batch at a time
+static pthread_t workers[SPRITE_MAX_WORKERS];
+static int n_workers = 0;
+static bool pool_running = false;
+static render_batch *current_batch = NULL;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_idle = PTHREAD_COND_INITIALIZER;
+
+// Only the latest prefetch request matters
+static pthread_t prefetch_thread;
+static pthread_cond_t prefetch_cond = PTHREAD_COND_INITIALIZER;
+static char prefetch_theme[THEME_NAME_SIZE];
+static int prefetch_width = 0;
+static int prefetch_height = 0;
+static bool prefetch_pending = false;
+static bool prefetch_running = false;
+
+/* Must be called with cache_lock held */
+static sprite_theme *find_theme(const char *name) {
+	int i;
+	for (i = 0; i < n_themes; i++) {
+		if (!strcmp(themes[i].name, name)) {
+			return &themes[i];
+		}
+	}
+	return NULL;
+}
+
+static void lru_unlink(sprite *s) {
+	if (s->prev) {
+		s->prev->next = s->next;
+	} else {
+		lru_head = s->next;
+	}
+	if (s->next) {
+		s->next->prev = s->prev;
+	} else {
+		lru_tail = s->prev;
+	}
+	s->prev = s->next = NULL;
+}
+
+static void lru_push_front(sprite *s) {
+	s->prev = NULL;
+	s->next = lru_head;
+	if (lru_head) {
+		lru_head->prev = s;
+	}
+	lru_head = s;
+	if (!lru_tail) {
+		lru_tail = s;
+	}
+}
+
+/* Must be called with cache_lock held. Bumps the sprite to the front on hit */
+static sprite *lookup(const char *theme, int type, int width, int height) {
+	sprite *s;
+	for (s = lru_head; s != NULL; s = s->next) {
+		if (s->type == type && s->width == width && s->height == height && !strcmp(s->theme, theme)) {
+			if (s != lru_head) {
+				lru_unlink(s);
+				lru_push_front(s);
+			}
+			return s;
+		}
+	}
+	return NULL;
+}
+
+/* Must be called with cache_lock held. Takes ownership of surf */
+static sprite *insert(const char *theme, int type, int width, int height, cairo_surface_t *surf) {
+	sprite *s = lookup(theme, type, width, height);
+	if (s != NULL) {
+		// somebody else rendered it meanwhile
+		cairo_surface_destroy(surf);
+		return s;
+	}
+
+	s = calloc(1, sizeof(sprite));
+	strncpy(s->theme, theme, THEME_NAME_SIZE - 1);
+	s->type = type;
+	s->width = width;
+	s->height = height;
+	s->surf = surf;
+	lru_push_front(s);
+	n_sprites++;
+
+	// evict least recently used, surfaces still in use keep their own reference
+	while (n_sprites > SPRITE_CACHE_SIZE) {
+		sprite *victim = lru_tail;
+		lru_unlink(victim);
+		cairo_surface_destroy(victim->surf);
+		free(victim);
+		n_sprites--;
+	}
+	return s;
+}
+
+/* Must be called with the piece's render lock held */
+static cairo_surface_t *render_sprite(sprite_theme *theme, int type, int width, int height) {
+	cairo_surface_t *surf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+	cairo_t *dc = cairo_create(surf);
+	cairo_scale(dc, width / theme->svg_width, height / theme->svg_height);
+	rsvg_handle_render_cairo(theme->handles[type], dc);
+	cairo_destroy(dc);
+	return surf;
+}
+
+void sprite_cache_add_theme(const char *theme, RsvgHandle *handles[12]) {
+	int i;
+	pthread_mutex_lock(&cache_lock);
+	if (find_theme(theme) != NULL || n_themes >= MAX_THEMES) {
+		pthread_mutex_unlock(&cache_lock);
+		return;
+	}
+	sprite_theme *t = &themes[n_themes];
+	strncpy(t->name, theme, THEME_NAME_SIZE - 1);
+	for (i = 0; i < 12; i++) {
+		t->handles[i] = handles[i];
+		pthread_mutex_init(&t->render_locks[i], NULL);
+	}
+
+	// all pieces are rendered relative to the queen's dimensions
+	RsvgDimensionData dimensions;
+	rsvg_handle_get_dimensions(handles[B_QUEEN], &dimensions);
+	t->svg_width = dimensions.width;
+	t->svg_height = dimensions.height;
+	n_themes++;
+	pthread_mutex_unlock(&cache_lock);
+}
+
+/* Must be called with cache_lock held */
+static cairo_surface_t *get_cached(const char *theme, int type, int width, int height) {
+	sprite *s = lookup(theme, type, width, height);
+	return s != NULL ? cairo_surface_reference(s->surf) : NULL;
+}
+
+/* Returns a new reference to the sprite, to be released with cairo_surface_destroy() */
+cairo_surface_t *sprite_cache_get(const char *theme, int type, int width, int height) {
+	pthread_mutex_lock(&cache_lock);
+	cairo_surface_t *surf = get_cached(theme, type, width, height);
+	pthread_mutex_unlock(&cache_lock);
+	if (surf != NULL) {
+		return surf;
+	}
+
+	pthread_mutex_lock(&cache_lock);
+	sprite_theme *t = find_theme(theme);
+	pthread_mutex_unlock(&cache_lock);
+	if (t == NULL) {
+		fprintf(stderr, "No such sprite theme: %s\n", theme);
+		return NULL;
+	}
+
+	// Lock order is render lock then cache_lock
+	pthread_mutex_lock(&t->render_locks[type]);
+
+	// another thread may have rendered it while we were waiting
+	pthread_mutex_lock(&cache_lock);
+	surf = get_cached(theme, type, width, height);
+	pthread_mutex_unlock(&cache_lock);
+
+	if (surf == NULL) {
+		debug("Sprite cache miss: %s %d %dx%d\n", theme, type, width, height);
+		cairo_surface_t *rendered = render_sprite(t, type, width, height);
+
+		pthread_mutex_lock(&cache_lock);
+		surf = cairo_surface_reference(insert(theme, type, width, height, rendered)->surf);
+		pthread_mutex_unlock(&cache_lock);
+	}
+
+	pthread_mutex_unlock(&t->render_locks[type]);
+	return surf;
+}
+
+/* Hand out pieces of the batch until there are none left. Must be called
+ * with pool_lock held: the batch lives on the stack of the thread that
+ * asked for it and is only guaranteed to exist while one of its pieces is
+ * claimed but not yet done */
+static void work_on_batch(render_batch *batch) {
+	while (batch->next_type < 12) {
+		int type = batch->next_type++;
+		pthread_mutex_unlock(&pool_lock);
+
+		cairo_surface_t *surf = sprite_cache_get(batch->theme, type, batch->width, batch->height);
+
+		pthread_mutex_lock(&pool_lock);
+		batch->sprites[type] = surf;
+		if (--batch->pending == 0) {
+			pthread_cond_broadcast(&pool_done);
+		}
+	}
+}
+
+static void *worker_function(void *ignored) {
+	pthread_mutex_lock(&pool_lock);
+	while (pool_running) {
+		if (current_batch == NULL || current_batch->next_type >= 12) {
+			pthread_cond_wait(&pool_work, &pool_lock);
+			continue;
+		}
+		work_on_batch(current_batch);
+	}
+	pthread_mutex_unlock(&pool_lock);
+	return NULL;
+}
+
+/* Fills sprites[] with new references to the 12 pieces, rendering the
+ * missing ones in parallel. The calling thread takes part in the work */
+void sprite_cache_get_set(const char *theme, int width, int height, cairo_surface_t *sprites[12]) {
+	render_batch batch;
+	batch.theme = theme;
+	batch.width = width;
+	batch.height = height;
+	batch.next_type = 0;
+	batch.pending = 12;
+	batch.sprites = sprites;
+
+	pthread_mutex_lock(&pool_lock);
+	while (current_batch != NULL) {
+		pthread_cond_wait(&pool_idle, &pool_lock);
+	}
+	current_batch = &batch;
+	pthread_cond_broadcast(&pool_work);
+
+	work_on_batch(&batch);
+
+	while (batch.pending > 0) {
+		pthread_cond_wait(&pool_done, &pool_lock);
+	}
+	current_batch = NULL;
+	pthread_cond_broadcast(&pool_idle);
+	pthread_mutex_unlock(&pool_lock);
+}
+
+/* Ask the background thread to render a full set of sprites at the given size */
+void sprite_cache_prefetch(const char *theme, int width, int height) {
+	if (width <= 0 || height <= 0) {
+		return;
+	}
+	pthread_mutex_lock(&cache_lock);
+	strncpy(prefetch_theme, theme, THEME_NAME_SIZE - 1);
+	prefetch_width = width;
+	prefetch_height = height;
+	prefetch_pending = true;
+	pthread_cond_signal(&prefetch_cond);
+	pthread_mutex_unlock(&cache_lock);
+}
+
+static void *prefetch_function(void *ignored) {
+	char theme[THEME_NAME_SIZE];
+	cairo_surface_t *sprites[12];
+	int width, height, type;
+
+	pthread_mutex_lock(&cache_lock);
+	while (prefetch_running) {
+		if (!prefetch_pending) {
+			pthread_cond_wait(&prefetch_cond, &cache_lock);
+			continue;
+		}
+		memcpy(theme, prefetch_theme, THEME_NAME_SIZE);
+		width = prefetch_width;
+		height = prefetch_height;
+		prefetch_pending = false;
+
+		pthread_mutex_unlock(&cache_lock);
+		sprite_cache_get_set(theme, width, height, sprites);
+		for (type = 0; type < 12; type++) {
+			cairo_surface_destroy(sprites[type]);
+		}
+		pthread_mutex_lock(&cache_lock);
+	}
+	pthread_mutex_unlock(&cache_lock);
+	return NULL;
+}
+
+void sprite_cache_init(void) {
+	int i;
+
+	// the thread asking for a set renders too, so one worker less
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	n_workers = cores > 1 ? (int) cores - 1 : 1;
+	if (n_workers > SPRITE_MAX_WORKERS) {
+		n_workers = SPRITE_MAX_WORKERS;
+	}
+	debug("Starting %d sprite rendering workers\n", n_workers);
+
+	pool_running = true;
+	for (i = 0; i < n_workers; i++) {
+		pthread_create(&workers[i], NULL, worker_function, NULL);
+	}
+
+	memset(prefetch_theme, 0, THEME_NAME_SIZE);
+	prefetch_running = true;
+	pthread_create(&prefetch_thread, NULL, prefetch_function, NULL);
+}
+
+void sprite_cache_cleanup(void) {
+	pthread_mutex_lock(&cache_lock);
+	prefetch_running = false;
+	pthread_cond_signal(&prefetch_cond);
+	pthread_mutex_unlock(&cache_lock);
+	pthread_join(prefetch_thread, NULL);
+
+	int i;
+	pthread_mutex_lock(&pool_lock);
+	pool_running = false;
+	pthread_cond_broadcast(&pool_work);
+	pthread_mutex_unlock(&pool_lock);
+	for (i = 0; i < n_workers; i++) {
+		pthread_join(workers[i], NULL);
+	}
+
+	while (lru_head != NULL) {
+		sprite *s = lru_head;
+		lru_unlink(s);
+		cairo_surface_destroy(s->surf);
+		free(s);
+	}
+	n_sprites = 0;
+}
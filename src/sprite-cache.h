@@ -0,0 +1,19 @@
+#ifndef __CAIRO_BOARD_SPRITE_CACHE_H__
+#define __CAIRO_BOARD_SPRITE_CACHE_H__
+
+#include <gtk/gtk.h>
+#include <librsvg/rsvg.h>
+
+// Max number of pre-rasterised sprites kept around (12 per board size)
+#define SPRITE_CACHE_SIZE 96
+// No point in more rendering threads than pieces
+#define SPRITE_MAX_WORKERS 11
+
+void sprite_cache_init(void);
+void sprite_cache_cleanup(void);
+void sprite_cache_add_theme(const char *theme, RsvgHandle *handles[12]);
+cairo_surface_t *sprite_cache_get(const char *theme, int type, int width, int height);
+void sprite_cache_get_set(const char *theme, int width, int height, cairo_surface_t *sprites[12]);
+void sprite_cache_prefetch(const char *theme, int width, int height);
+
+#endif